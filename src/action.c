@@ -1,8 +1,13 @@
+#include "action.h"
 #include "effect.h"
+#include "frame.h"
+#include "render.h"
 #include "session.h"
+#include "slab.h"
+#include "trace.h"
 #include "util.h"
 #include "window.h"
-#include <sys/time.h>
+#include <stdlib.h>
 
 typedef struct _action {
     struct _action *next;
@@ -15,17 +20,34 @@ typedef struct _action {
     effect_func effect;
     void *effect_data;
     Bool gone;
+    Bool moving; // started by action_move, its effect only sets the offsets
 } action;
 
-static action *actions;
-static int effect_time = 0;
+// a window animated by the group of a desktop change
+typedef struct _group_member {
+    win *w;
+    effect_func effect;
+    void *effect_data;
+    Bool outgoing; // goes from 1 to 0 and is unmapped once the group is over
+} group_member;
 
-static int get_time_in_milliseconds(void) {
-    struct timeval tv;
+/*
+ * the windows of a desktop change share one progress and damage the screen once per step
+ */
+static struct {
+    group_member *members;
+    int n, size;
+    double progress;
+    double step;
+} group;
 
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec * 1000 + tv.tv_usec / 1000;
-}
+// windows whose dim fades to their dim_target, stepped along with the actions
+static win **dimming = NULL;
+static int n_dimming = 0, size_dimming = 0;
+
+static slab_pool action_pool = SLAB_POOL(action);
+static action *actions;
+static int effect_time = 0;
 
 static action *action_find(win *w) {
     for (action *a = actions; a; a = a->next) {
@@ -39,43 +61,126 @@ static void action_dequeue(action *a) {
     for (action **prev = &actions; *prev; prev = &(*prev)->next) {
         if (*prev == a) {
             *prev = a->next;
+            if (a->moving)
+                a->w->offset_x = a->w->offset_y = 0;
             if (a->callback)
                 (*a->callback)(a->w, a->gone);
             if (a->effect_data)
                 free(a->effect_data);
-            free(a);
+            slab_free(&action_pool, a);
             break;
         }
     }
 }
 
+static group_member *group_find(win *w) {
+    for (int i = 0; i < group.n; i++)
+        if (group.members[i].w == w)
+            return &group.members[i];
+    return NULL;
+}
+
+/*
+ * w leaves the group where it is, the effect is not brought to its end
+ */
+static void group_remove(win *w) {
+    group_member *m = group_find(w);
+    if (!m)
+        return;
+    free(m->effect_data);
+    *m = group.members[--group.n];
+}
+
+static void dim_remove(win *w) {
+    for (int i = 0; i < n_dimming; i++) {
+        if (dimming[i] == w) {
+            dimming[i] = dimming[--n_dimming];
+            return;
+        }
+    }
+}
+
 void action_cleanup(win *w) {
     action *a = action_find(w);
     if (a)
         action_dequeue(a);
+    group_remove(w);
+    dim_remove(w);
 }
 
-static void action_enqueue(action *a) {
-    if (!actions)
+static void effect_time_start(void) {
+    if (!actions && !group.n && !n_dimming)
         effect_time = get_time_in_milliseconds() + s.effect_delta;
+}
+
+static void action_enqueue(action *a) {
+    effect_time_start();
     a->next = actions;
     actions = a;
 }
 
+Bool action_get_state(win *w, action_state *state) {
+    group_member *m = group_find(w);
+    if (m) {
+        if (m->outgoing)
+            return False;
+        // carried on by the next instance as an action of its own
+        state->effect = get_effect_func_name(m->effect);
+        state->progress = group.progress;
+        state->end = 1.0;
+        state->step = group.step;
+        state->opacity = m->effect_data ? *(double *) m->effect_data : w->opacity;
+        return state->effect != NULL;
+    }
+
+    action *a = action_find(w);
+    // the offsets of a move are relative to where the window was painted
+    if (!a || a->callback || a->moving)
+        return False;
+
+    state->effect = get_effect_func_name(a->effect);
+    state->progress = a->progress;
+    state->end = a->end;
+    state->step = a->step;
+    // fade and pop keep the opacity they go back to in their effect data
+    state->opacity = a->effect_data ? *(double *) a->effect_data : w->opacity;
+    return state->effect != NULL;
+}
+
+void action_set_state(win *w, const action_state *state) {
+    effect_func func = get_effect_func_from_name(state->effect);
+    if (!func || action_find(w))
+        return;
+
+    action *a = slab_alloc(&action_pool);
+    a->w = w;
+    a->progress = state->progress;
+    a->end = state->end;
+    a->step = state->step;
+    a->effect = func;
+    action_enqueue(a);
+
+    (*a->effect)(w, a->progress, &a->effect_data);
+}
+
 void action_set(win *w, effect *e, Bool reverse, void (*callback)(win *w, Bool gone), Bool gone, Bool exec_callback) {
     double start = reverse ? 1.0 : 0.0;
     double end = reverse ? 0.0 : 1.0;
 
+    group_remove(w);
     action *a = action_find(w);
     if (!a) {
-        a = malloc(sizeof(action));
-        a->next = NULL;
+        a = slab_alloc(&action_pool);
         a->w = w;
         a->progress = start;
         action_enqueue(a);
     } else if (exec_callback && a->callback) {
         (*a->callback)(a->w, a->gone);
     }
+    if (a->moving) {
+        w->offset_x = w->offset_y = 0;
+        a->moving = False;
+    }
 
     a->end = end;
     if (a->progress < end)
@@ -90,8 +195,170 @@ void action_set(win *w, effect *e, Bool reverse, void (*callback)(win *w, Bool g
     (*a->effect)(w, a->progress, &a->effect_data);
 }
 
+Bool action_move(win *w, effect *e, int dx, int dy) {
+    action *a = action_find(w);
+    if (group_find(w) || (a && !a->moving))
+        return False;
+
+    if (!a) {
+        a = slab_alloc(&action_pool);
+        a->w = w;
+        a->moving = True;
+        action_enqueue(a);
+        w->offset_x = w->offset_y = 0;
+    } else {
+        free(a->effect_data);
+        a->effect_data = NULL;
+    }
+    // the window is still painted where it was, the effect brings it to its new position
+    w->offset_x -= dx;
+    w->offset_y -= dy;
+    a->progress = 0.0;
+    a->end = 1.0;
+    a->step = e->step;
+    a->effect = e->func;
+    (*a->effect)(w, a->progress, &a->effect_data);
+
+    // painted with the offsets from this frame on, see action_run for the mode
+    w->action_running = True;
+    win_set_mode(w);
+    w->mode = w->mode == WINDOW_SOLID ? WINDOW_ARGB : w->mode;
+    return True;
+}
+
+void action_group_add(win *w, effect *e, Bool outgoing) {
+    // a window is either in an action or in the group
+    action_cleanup(w);
+    if (!group.n) {
+        effect_time_start();
+        group.progress = 0.0;
+        group.step = e->step;
+    }
+    if (group.n == group.size) {
+        group.size = group.size ? group.size * 2 : 16;
+        group.members = realloc(group.members, group.size * sizeof(group_member));
+        if (!group.members)
+            eprintf("out of memory\n");
+    }
+
+    group_member *m = &group.members[group.n++];
+    m->w = w;
+    m->effect = e->func;
+    m->effect_data = NULL;
+    m->outgoing = outgoing;
+    (*m->effect)(w, outgoing ? 1.0 - group.progress : group.progress, &m->effect_data);
+}
+
+/*
+ * the members go back to their own mode, the outgoing ones are unmapped
+ */
+static void group_finish(void) {
+    int n = group.n;
+    group.n = 0; // finish_unmap_win must not see the members anymore
+    for (int i = 0; i < n; i++) {
+        group_member *m = &group.members[i];
+        m->w->action_running = False;
+        free(m->effect_data);
+        win_set_mode(m->w);
+        if (m->outgoing)
+            finish_unmap_win(m->w);
+    }
+}
+
+void action_group_end(void) {
+    if (!group.n)
+        return;
+    for (int i = 0; i < group.n; i++) {
+        group_member *m = &group.members[i];
+        (*m->effect)(m->w, m->outgoing ? 0.0 : 1.0, &m->effect_data);
+    }
+    group_finish();
+}
+
+/*
+ * steps every member at once, the area they leave and the area they are painted to
+ * make up a single damage region
+ */
+static void group_run(int steps) {
+    if (!group.n)
+        return;
+
+    group.progress += group.step * steps;
+    if (group.progress > 1)
+        group.progress = 1;
+
+    XRectangle *rects = frame_alloc(group.n * 4 * sizeof(XRectangle));
+    int n_rects = 0;
+    for (int i = 0; i < group.n; i++) {
+        group_member *m = &group.members[i];
+        win *w = m->w;
+        n_rects += win_extents_rects(w, &rects[n_rects]);
+
+        TRACE_BEGIN("effect");
+        (*m->effect)(w, m->outgoing ? 1.0 - group.progress : group.progress, &m->effect_data);
+        TRACE_END("effect");
+        w->action_running = True;
+        win_set_mode(w);
+        // same fix as in action_run, the window is never solid while it moves
+        w->mode = w->mode == WINDOW_SOLID ? WINDOW_ARGB : w->mode;
+
+        int n = win_extents_rects(w, &rects[n_rects]);
+        if (w->extents)
+            XFixesSetRegion(s.dpy, w->extents, &rects[n_rects], n);
+        n_rects += n;
+    }
+    add_damage(frame_region(rects, n_rects));
+
+    if (group.progress >= 1)
+        group_finish();
+}
+
+void action_dim(win *w, double dim) {
+    w->cold->dim_target = dim;
+    if (w->dim == dim)
+        return;
+    if (!s.inactive_dim_step || !w->damaged) {
+        dim_remove(w);
+        w->dim = dim;
+        if (w->extents)
+            add_damage(w->extents);
+        return;
+    }
+
+    for (int i = 0; i < n_dimming; i++)
+        if (dimming[i] == w)
+            return;
+    effect_time_start();
+    if (n_dimming == size_dimming) {
+        size_dimming = size_dimming ? size_dimming * 2 : 16;
+        dimming = realloc(dimming, size_dimming * sizeof(win *));
+        if (!dimming)
+            eprintf("out of memory\n");
+    }
+    dimming[n_dimming++] = w;
+}
+
+static void dim_run(int steps) {
+    double delta = s.inactive_dim_step * steps;
+    for (int i = 0; i < n_dimming;) {
+        win *w = dimming[i];
+        double target = w->cold->dim_target;
+        if (w->dim < target)
+            w->dim = w->dim + delta < target ? w->dim + delta : target;
+        else
+            w->dim = w->dim - delta > target ? w->dim - delta : target;
+        if (w->extents)
+            add_damage(w->extents);
+
+        if (w->dim == target)
+            dimming[i] = dimming[--n_dimming];
+        else
+            i++;
+    }
+}
+
 int action_timeout(void) {
-    if (!actions)
+    if (!actions && !group.n && !n_dimming)
         return -1;
     int now = get_time_in_milliseconds();
     int delta = effect_time - now;
@@ -109,6 +376,7 @@ void action_run(void) {
     if (effect_time - now > 0)
         return;
     steps = 1 + (now - effect_time) / s.effect_delta;
+    TRACE_BEGIN("action_run");
 
     while (next) {
         action *a = next;
@@ -120,7 +388,9 @@ void action_run(void) {
         else if (a->progress < 0)
             a->progress = 0;
 
+        TRACE_BEGIN("effect");
         (*a->effect)(w, a->progress, &a->effect_data);
+        TRACE_END("effect");
         w->action_running = True;
         need_dequeue = False;
         if (a->step > 0) {
@@ -139,6 +409,8 @@ void action_run(void) {
         // this is ugly : we force the window to never be solid while an action is running
         // this prevents painting glitches
         w->mode = w->mode == WINDOW_SOLID ? WINDOW_ARGB : w->mode;
+        // the effect may have scaled or moved the window, damage where it is painted now
+        win_update_extents(w);
 
         // Must do this last as it might destroy a->w in callbacks
         if (need_dequeue) {
@@ -147,5 +419,8 @@ void action_run(void) {
             w->action_running = False;
         }
     }
+    group_run(steps);
+    dim_run(steps);
     effect_time = now + s.effect_delta;
+    TRACE_END("action_run");
 }
@@ -3,10 +3,53 @@
 #include "effect.h"
 #include "window.h"
 
+// what another compix instance needs to carry on a running action
+typedef struct _action_state {
+    const char *effect; // name of the effect function
+    double progress;
+    double end;
+    double step;
+    double opacity; // opacity of the window once the effect is over
+} action_state;
+
 void action_cleanup(win *w);
 
+/*
+ * fills the state of the action running on w
+ * returns False if there is none or if it ends with a callback (unmap or destroy)
+ */
+Bool action_get_state(win *w, action_state *state);
+
+/*
+ * starts an action on w from the state of another instance, w->opacity must be the opacity once it is over
+ */
+void action_set_state(win *w, const action_state *state);
+
 void action_set(win *w, effect *e, Bool reverse, void (*callback)(win *w, Bool gone), Bool gone, Bool exec_callback);
 
+/*
+ * starts the move effect of a window that moved by dx, dy, or restarts it from where the window is painted
+ * returns False if another action runs on w, the move is then not animated
+ */
+Bool action_move(win *w, effect *e, int dx, int dy);
+
+/*
+ * animates w with the other windows of a desktop change, they all share the progress of the group
+ * outgoing windows are animated backwards and unmapped at the end
+ */
+void action_group_add(win *w, effect *e, Bool outgoing);
+
+/*
+ * brings the windows of the running desktop change to the end of their effect at once
+ */
+void action_group_end(void);
+
+/*
+ * fades the dim of w to dim, at once if s.inactive_dim_step is 0
+ * unlike the other actions it does not change the mode of the window
+ */
+void action_dim(win *w, double dim);
+
 int action_timeout(void);
 
 void action_run(void);
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+#include "capture.h"
+#include "frame.h"
+#include "render.h"
+#include "session.h"
+#include "trace.h"
+#include "util.h"
+#include <X11/Xlib-xcb.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <xcb/shm.h>
+#include <xcb/xcb.h>
+
+#define CAPTURE_FRAMES 4
+#define ALIGN(size) (((size) + 63) & ~(size_t) 63)
+
+static int listen_fd = -1;
+static int *clients = NULL;
+static int n_clients = 0, size_clients = 0;
+
+// the ring shared by every client and attached to the server, which writes the pixels into it
+static int ring_fd = -1;
+static capture_header *ring = NULL;
+static size_t ring_size;
+static xcb_shm_seg_t ring_seg;
+static uint32_t sequence = 0;
+
+int capture_listen(void) {
+    const char *path = runtime_path("capture");
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+        fprintf(stderr, "cannot listen for capture clients on %s\n", path);
+        close(fd);
+        return -1;
+    }
+    listen_fd = fd;
+    return fd;
+}
+
+static Bool ring_create(void) {
+    size_t header_size = ALIGN(sizeof(capture_header));
+    size_t frame_size = ALIGN(sizeof(capture_frame)) + (size_t) s.root_width * s.root_height * 4;
+
+    ring_size = header_size + CAPTURE_FRAMES * frame_size;
+    ring_fd = memfd_create("compix-capture", MFD_CLOEXEC);
+    if (ring_fd < 0)
+        return False;
+    if (ftruncate(ring_fd, ring_size) < 0 ||
+        (ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "cannot map the capture ring\n");
+        close(ring_fd);
+        ring = NULL;
+        return False;
+    }
+
+    ring->magic = CAPTURE_MAGIC;
+    ring->version = CAPTURE_VERSION;
+    ring->width = s.root_width;
+    ring->height = s.root_height;
+    ring->header_size = header_size;
+    ring->frame_size = frame_size;
+    ring->n_frames = CAPTURE_FRAMES;
+    ring->sequence = sequence = 0;
+
+    xcb_connection_t *c = XGetXCBConnection(s.dpy);
+    ring_seg = xcb_generate_id(c);
+    // xcb closes the fd once it is sent
+    xcb_shm_attach_fd(c, ring_seg, dup(ring_fd), 0);
+    return True;
+}
+
+static void ring_destroy(void) {
+    xcb_shm_detach(XGetXCBConnection(s.dpy), ring_seg);
+    munmap(ring, ring_size);
+    close(ring_fd);
+    ring = NULL;
+    ring_fd = -1;
+}
+
+static Bool send_ring(int client) {
+    char byte = 0;
+    struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+    union {
+        struct cmsghdr header;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf, .msg_controllen = sizeof(control.buf)};
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &ring_fd, sizeof(int));
+    return sendmsg(client, &msg, MSG_NOSIGNAL) == 1;
+}
+
+void capture_accept(void) {
+    int client;
+    while ((client = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        if (!render_pictures()) {
+            fprintf(stderr, "capture is only supported by the xrender backend\n");
+            close(client);
+            continue;
+        }
+        if ((!ring && !ring_create()) || !send_ring(client)) {
+            close(client);
+            continue;
+        }
+
+        if (n_clients == size_clients) {
+            size_clients = size_clients ? size_clients * 2 : 4;
+            clients = realloc(clients, size_clients * sizeof(int));
+            if (!clients)
+                eprintf("out of memory\n");
+        }
+        clients[n_clients++] = client;
+
+        // the new client has nothing of the screen yet
+        XRectangle screen = {0, 0, s.root_width, s.root_height};
+        add_damage(frame_region(&screen, 1));
+    }
+}
+
+static void client_remove(int i) {
+    close(clients[i]);
+    clients[i] = clients[--n_clients];
+}
+
+/*
+ * clients never write to their socket, it is only readable once they are gone
+ */
+static void drop_closed_clients(void) {
+    for (int i = 0; i < n_clients;) {
+        char byte;
+        ssize_t r = recv(clients[i], &byte, 1, MSG_DONTWAIT);
+        if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+            client_remove(i);
+        else
+            i++;
+    }
+}
+
+void capture_update(XserverRegion region) {
+    if (!n_clients)
+        return;
+    drop_closed_clients();
+    if (ring && (ring->width != s.root_width || ring->height != s.root_height)) {
+        // the frames don't fit anymore, the clients connect again to get a new ring
+        while (n_clients)
+            client_remove(0);
+    }
+    if (!n_clients) {
+        if (ring)
+            ring_destroy();
+        return;
+    }
+
+    TRACE_BEGIN("capture");
+    XRectangle screen = {0, 0, s.root_width, s.root_height}, bounds;
+    XRectangle *rects = &screen;
+    int n = 1;
+    if (region) {
+        rects = XFixesFetchRegionAndBounds(s.dpy, region, &n, &bounds);
+        if (n > CAPTURE_MAX_RECTS) {
+            XFree(rects);
+            rects = NULL;
+            n = 1;
+        }
+    }
+
+    sequence++;
+    size_t frame_offset = ring->header_size + (sequence % ring->n_frames) * ring->frame_size;
+    capture_frame *f = (capture_frame *) ((char *) ring + frame_offset);
+    __atomic_store_n(&f->sequence, sequence, __ATOMIC_RELEASE);
+
+    xcb_connection_t *c = XGetXCBConnection(s.dpy);
+    xcb_shm_get_image_cookie_t *cookies = frame_alloc(n * sizeof(xcb_shm_get_image_cookie_t));
+    uint32_t offset = ALIGN(sizeof(capture_frame));
+    int n_rects = 0;
+    for (int i = 0; i < n; i++) {
+        XRectangle *r = rects ? &rects[i] : &bounds;
+        // damage can reach past the screen
+        int x1 = r->x > 0 ? r->x : 0;
+        int y1 = r->y > 0 ? r->y : 0;
+        int x2 = r->x + r->width < s.root_width ? r->x + r->width : s.root_width;
+        int y2 = r->y + r->height < s.root_height ? r->y + r->height : s.root_height;
+        if (x1 >= x2 || y1 >= y2)
+            continue;
+
+        capture_rect *cr = &f->rects[n_rects];
+        cr->x = x1;
+        cr->y = y1;
+        cr->width = x2 - x1;
+        cr->height = y2 - y1;
+        cr->offset = offset;
+        cookies[n_rects++] = xcb_shm_get_image(c, s.root_buffer_pixmap, cr->x, cr->y, cr->width, cr->height,
+                                               ~0, XCB_IMAGE_FORMAT_Z_PIXMAP, ring_seg, frame_offset + offset);
+        offset += cr->width * cr->height * 4;
+    }
+    f->n_rects = n_rects;
+    if (rects && rects != &screen)
+        XFree(rects);
+
+    // the pixels are written once the replies come back, all of them in a single round-trip
+    for (int i = 0; i < n_rects; i++)
+        free(xcb_shm_get_image_reply(c, cookies[i], NULL));
+    __atomic_store_n(&ring->sequence, sequence, __ATOMIC_RELEASE);
+    TRACE_END("capture");
+}
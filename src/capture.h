@@ -0,0 +1,57 @@
+#pragma once
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xfixes.h>
+#include <stdint.h>
+
+/*
+ * exports the composited frames to screen recorders, with the xrender backend only
+ * a client connects to the unix socket runtime_path("capture") and receives a memfd in a one byte message,
+ * the memfd holds a capture_header followed by a ring of frames
+ * a frame only holds the pixels of the rectangles damaged since the previous one, so a client keeps
+ * its own copy of the screen and applies the frames it did not read yet in order
+ * the first frame after a client connected covers the whole screen
+ * a client that fell more than n_frames behind, or whose socket was closed because the root was resized,
+ * connects again
+ */
+
+#define CAPTURE_MAGIC 0x50434358 // "XCCP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_MAX_RECTS 64 // a frame with more damaged rectangles holds their bounding box
+
+typedef struct _capture_rect {
+    int16_t x, y;
+    uint16_t width, height;
+    uint32_t offset; // of the pixels from the start of the frame, rows of width * 4 bytes
+} capture_rect;
+
+typedef struct _capture_frame {
+    uint32_t sequence; // set before the pixels are written, the frame is complete once the header has it
+    uint32_t n_rects;
+    capture_rect rects[CAPTURE_MAX_RECTS];
+} capture_frame;
+
+typedef struct _capture_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width, height; // of the root, pixels are 32 bits in the format of the root visual
+    uint32_t header_size;   // frame i starts at header_size + i * frame_size
+    uint32_t frame_size;
+    uint32_t n_frames;
+    uint32_t sequence; // of the last complete frame, which is frame sequence % n_frames
+} capture_header;
+
+/*
+ * creates the socket capture clients connect to, returns its fd or -1
+ */
+int capture_listen(void);
+
+/*
+ * accepts the clients waiting on the socket
+ */
+void capture_accept(void);
+
+/*
+ * copies the region of the frame just painted to the ring, does nothing without clients
+ */
+void capture_update(XserverRegion region);
@@ -0,0 +1,124 @@
+#include "coalesce.h"
+#include "session.h"
+#include <X11/Xlib.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/shape.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum _pending_kind {
+    PENDING_NONE,      // the event is never merged and does not stop a merge
+    PENDING_CONFIGURE, // the last configure holds the final geometry and stacking
+    PENDING_OPACITY,   // the handlers read the property again, only the last change matters
+    PENDING_WINSTATE,
+    PENDING_DAMAGE,    // the damage is subtracted as a whole by the last event
+    PENDING_OTHER      // any other event of the window, it stops merges across it
+} pending_kind;
+
+// the next event of a window in the batch, filled walking the batch backwards
+typedef struct _pending_state {
+    Window id;
+    pending_kind next;
+    unsigned long restacks; // stacking changes after the next event
+} pending_state;
+
+static pending_state *pending = NULL;
+static int size_pending = 0;
+
+static pending_kind event_kind(XEvent *ev, Window *id, Bool *restacks) {
+    *restacks = False;
+    switch (ev->type) {
+    case ConfigureNotify:
+        *id = ev->xconfigure.window;
+        *restacks = True;
+        return PENDING_CONFIGURE;
+    case CreateNotify:
+        *id = ev->xcreatewindow.window;
+        break;
+    case DestroyNotify:
+        *id = ev->xdestroywindow.window;
+        break;
+    case MapNotify:
+        *id = ev->xmap.window;
+        break;
+    case UnmapNotify:
+        *id = ev->xunmap.window;
+        break;
+    case ReparentNotify:
+        *id = ev->xreparent.window;
+        break;
+    case CirculateNotify:
+        *id = ev->xcirculate.window;
+        break;
+    case PropertyNotify:
+        *id = ev->xproperty.window;
+        if (ev->xproperty.atom == s.opacity_atom)
+            return PENDING_OPACITY;
+        if (ev->xproperty.atom == s.winstate_atoms[NUM_WINSTATES])
+            return PENDING_WINSTATE;
+        return PENDING_NONE;
+    default:
+        if (ev->type == s.damage_event + XDamageNotify) {
+            *id = ((XDamageNotifyEvent *) ev)->drawable;
+            return PENDING_DAMAGE;
+        }
+        if (ev->type == s.xshape_event + ShapeNotify) {
+            *id = ((XShapeEvent *) ev)->window;
+            return PENDING_OTHER;
+        }
+        return PENDING_NONE;
+    }
+    // the structure of the tree changed, no configure is merged across it
+    *restacks = True;
+    return PENDING_OTHER;
+}
+
+static pending_state *pending_find(Window id) {
+    int mask = size_pending - 1;
+    int i = (id * 2654435761u) & mask;
+    while (pending[i].id && pending[i].id != id)
+        i = (i + 1) & mask;
+    if (!pending[i].id) {
+        pending[i].id = id;
+        pending[i].next = PENDING_NONE;
+    }
+    return &pending[i];
+}
+
+int coalesce_events(XEvent *events, int n) {
+    unsigned long restacks = 0;
+    int size = 16;
+    while (size < 2 * n)
+        size *= 2;
+    if (size > size_pending) {
+        pending = realloc(pending, size * sizeof(pending_state));
+        size_pending = size;
+    }
+    memset(pending, 0, size_pending * sizeof(pending_state));
+
+    for (int i = n - 1; i >= 0; i--) {
+        Window id;
+        Bool stacking;
+        pending_kind kind = event_kind(&events[i], &id, &stacking);
+        if (kind == PENDING_NONE)
+            continue;
+
+        pending_state *p = pending_find(id);
+        // another window moving in between could end up stacked differently
+        if (kind != PENDING_OTHER && p->next == kind &&
+            (kind != PENDING_CONFIGURE || p->restacks == restacks)) {
+            events[i].type = 0;
+            continue;
+        }
+        if (stacking)
+            restacks++;
+        p->next = kind;
+        p->restacks = restacks;
+    }
+
+    int kept = 0;
+    for (int i = 0; i < n; i++)
+        if (events[i].type)
+            events[kept++] = events[i];
+    return kept;
+}
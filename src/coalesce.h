@@ -0,0 +1,10 @@
+#pragma once
+
+#include <X11/Xlib.h>
+
+/*
+ * drops the events of a batch superseded by a later event of the same window
+ * consecutive configures, opacity and state changes and damage of a window are merged into the last one
+ * the remaining events keep their order, returns their count
+ */
+int coalesce_events(XEvent *events, int n);
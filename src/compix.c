@@ -1,4 +1,5 @@
 #include "session.h"
+#include "trace.h"
 #include <X11/extensions/Xdamage.h>
 #include <getopt.h>
 #include <stdio.h>
@@ -11,6 +12,14 @@ static void usage(const char *program, Bool failed) {
             "      Specifies which display should be managed.\n"
             "   -c path\n"
             "      Specifies configuration file path.\n"
+            "   -b backend\n"
+            "      Specifies the rendering backend, xrender (default), glx or pixman.\n"
+            "   -p\n"
+            "      Presents frames at vblank with the Present extension (xrender backend).\n"
+            "   -r\n"
+            "      Replaces the running compix, taking over its windows and running effects.\n"
+            "   -t path\n"
+            "      Writes a Chrome trace of each frame to path (needs a build with make trace).\n"
             "   -h help\n"
             "      Show this message.\n");
 
@@ -21,16 +30,10 @@ static void usage(const char *program, Bool failed) {
 
 // TODO use shared memory extension for huge performance boost (Xshm)
 
-// TODO features : shadows, fade in fade out, pop in pop out, gnome like maximize/minimize animation, dim inactive
+// TODO features : shadows, fade in fade out, pop in pop out, gnome like maximize/minimize animation
 // dock type windows appear gliding from the side (make funtion to detect wich side the dock is likely to be attached),
-// detection of desktop change for special effects (current desktop var in memory and when a client is managed, we keep in memory its desktop)
-// this only works for ewmh or icccm (check wich one) WMs
-// when a desktop change (root window desktop prop change) we apply effects to clients from prev and new desktop
 // we can also make special effects when a desktop change of a non root window (window change desktop)
-// this can cause conflicts with awesomewm combinable desktop (or tags) system but this is not a behaviour most WMs use
-// because we can't get all desktops associated with a window but only one
-// one way to fix this in awesome is to use setproperty() from xproperties in awesome config to set a new property that is a list of desktops
-// but this is a hacky way. (after reading doc it this is an incomplete implementation so its better to use xprop command spawned with easy_async)
+// awesomewm combinable desktops (tags) are not animated as a desktop change because _NET_WM_DESKTOP only holds one desktop
 
 // TODO disable when fullscreen app detected (for gaming performances)
 // TODO vsync ?
@@ -58,9 +61,10 @@ static void usage(const char *program, Bool failed) {
 // remove start and end from actions ? (make it go from 0 to 1 all the time and the effect functions do the rest ?)
 
 int main(int argc, char **argv) {
-    char *display = NULL, *config_path = NULL;
+    char *display = NULL, *config_path = NULL, *backend_name = NULL;
+    Bool use_present = False, replace = False;
     char o;
-    while ((o = getopt(argc, argv, "hd:c:")) != -1) {
+    while ((o = getopt(argc, argv, "hd:c:b:prt:")) != -1) {
         switch (o) {
         case 'h':
             usage(argv[0], False);
@@ -71,13 +75,29 @@ int main(int argc, char **argv) {
         case 'c':
             config_path = optarg;
             break;
+        case 'b':
+            backend_name = optarg;
+            break;
+        case 'p':
+            use_present = True;
+            break;
+        case 'r':
+            replace = True;
+            break;
+        case 't':
+#ifdef TRACE
+            trace_open(optarg);
+#else
+            fprintf(stderr, "compix was built without tracing, -t is ignored\n");
+#endif
+            break;
         default:
             usage(argv[0], True);
             break;
         }
     }
 
-    session_init(display, config_path);
+    session_init(display, config_path, backend_name, use_present, replace);
 
     session_loop();
 
@@ -1,11 +1,16 @@
 #include "effect.h"
+#include "governor.h"
+#include "render.h"
 #include "session.h"
 #include "util.h"
 #include "window.h"
 #include <basedir.h>
 #include <confuse.h>
+#include <libgen.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
 
 static int validate_unsigned_int(cfg_t *cfg, cfg_opt_t *opt) {
     int value = cfg_opt_getnint(opt, cfg_opt_size(opt) - 1);
@@ -46,6 +51,9 @@ Bool file_exists(const char *path) {
     return True;
 }
 
+// resolved at startup and read again on every reload
+static const char *config_file;
+
 static const char *config_get_path(const char *config_path) {
     if (file_exists(config_path))
         return config_path;
@@ -84,9 +92,22 @@ static const char *config_get_path(const char *config_path) {
     return NULL;
 }
 
-void config_get(const char *config_path) {
-    const char *path = config_get_path(config_path);
+// global options, applied along with the effect table
+typedef struct _config_options {
+    int effect_delta;
+    int damage_hot_rate;
+    int damage_cool_rate;
+    double inactive_dim;
+    double inactive_dim_step;
+    int corner_radius[NUM_WINTYPES];
+    Bool frame_governor;
+} config_options;
 
+/*
+ * parses the config file into a new effect table
+ * returns NULL if the file is invalid, the errors are printed on stderr
+ */
+static effect_table *config_parse(const char *path, config_options *options) {
     cfg_opt_t effect_opts[] = {
         CFG_STR("function", NULL, CFGF_NONE),
         CFG_FLOAT("step", 0.03, CFGF_NONE),
@@ -99,12 +120,18 @@ void config_get(const char *config_path) {
         CFG_STR("maximize-effect", NULL, CFGF_NONE),
         CFG_STR("move-effect", NULL, CFGF_NONE),
         CFG_STR("desktop-change-effect", NULL, CFGF_NONE),
+        CFG_INT("corner-radius", 0, CFGF_NONE),
         CFG_END()};
     cfg_opt_t effect_rules_opts[] = {
         CFG_SEC("wintype", wintype_opts, CFGF_TITLE | CFGF_MULTI),
         CFG_END()};
     cfg_opt_t opts[] = {
         CFG_INT("effect-delta", 10, CFGF_NONE),
+        CFG_INT("damage-hot-rate", 30, CFGF_NONE),
+        CFG_INT("damage-cool-rate", 10, CFGF_NONE),
+        CFG_FLOAT("inactive-dim", 0.0, CFGF_NONE),
+        CFG_FLOAT("inactive-dim-step", 0.0, CFGF_NONE),
+        CFG_BOOL("frame-governor", cfg_true, CFGF_NONE),
         CFG_SEC("effect", effect_opts, CFGF_TITLE | CFGF_MULTI),
         CFG_SEC("effect-rules", effect_rules_opts, CFGF_NONE),
         CFG_END()};
@@ -113,24 +140,53 @@ void config_get(const char *config_path) {
     cfg = cfg_init(opts, CFGF_NONE);
 
     cfg_set_validate_func(cfg, "effect-delta", validate_unsigned_int);
+    cfg_set_validate_func(cfg, "damage-hot-rate", validate_unsigned_int);
+    cfg_set_validate_func(cfg, "damage-cool-rate", validate_unsigned_int);
+    cfg_set_validate_func(cfg, "inactive-dim", validate_unsigned_float);
+    cfg_set_validate_func(cfg, "inactive-dim-step", validate_unsigned_float);
+    cfg_set_validate_func(cfg, "effect-rules|wintype|corner-radius", validate_unsigned_int);
     cfg_set_validate_func(cfg, "effect|step", validate_unsigned_float);
     cfg_set_validate_func(cfg, "effect|function", validate_effect_function);
 
-    if (cfg_parse(cfg, path) == CFG_PARSE_ERROR)
-        exit(EXIT_FAILURE);
+    if (cfg_parse(cfg, path) == CFG_PARSE_ERROR) {
+        cfg_free(cfg);
+        return NULL;
+    }
 
-    s.effect_delta = cfg_getint(cfg, "effect-delta");
+    options->damage_hot_rate = cfg_getint(cfg, "damage-hot-rate");
+    options->damage_cool_rate = cfg_getint(cfg, "damage-cool-rate");
+    if (options->damage_hot_rate && options->damage_cool_rate > options->damage_hot_rate) {
+        fprintf(stderr, "%s: option 'damage-cool-rate' must not be greater than 'damage-hot-rate'\n", path);
+        cfg_free(cfg);
+        return NULL;
+    }
+
+    options->inactive_dim = cfg_getfloat(cfg, "inactive-dim");
+    options->inactive_dim_step = cfg_getfloat(cfg, "inactive-dim-step");
+    if (options->inactive_dim > 1.0) {
+        fprintf(stderr, "%s: option 'inactive-dim' must not be greater than 1\n", path);
+        cfg_free(cfg);
+        return NULL;
+    }
+
+    options->frame_governor = cfg_getbool(cfg, "frame-governor");
+    memset(options->corner_radius, 0, sizeof(options->corner_radius));
+    effect_table *t = effect_table_new();
+    options->effect_delta = cfg_getint(cfg, "effect-delta");
 
     for (int i = 0; i < cfg_size(cfg, "effect"); i++) {
         cfg_sec = cfg_getnsec(cfg, "effect", i);
 
-        char *effect_function = cfg_getstr(cfg_sec, "function");
-        if (!effect_function) // TODO put conf file path in error msg
-            eprintf("(TODO conf file path here): option 'function' must be set in section 'effect %s'\n", cfg_title(cfg_sec));
-
-        effect_new(cfg_title(cfg_sec), effect_function, cfg_getfloat(cfg_sec, "step"));
+        const char *effect_function = cfg_getstr(cfg_sec, "function");
+        if (!effect_function) {
+            fprintf(stderr, "%s: option 'function' must be set in section 'effect %s'\n", path, cfg_title(cfg_sec));
+            goto error;
+        }
 
-        free(effect_function);
+        if (!effect_new(t, cfg_title(cfg_sec), effect_function, cfg_getfloat(cfg_sec, "step"))) {
+            fprintf(stderr, "%s: effect '%s' is defined more than once\n", path, cfg_title(cfg_sec));
+            goto error;
+        }
     }
 
     for (int i = 0; i < cfg_size(cfg, "effect-rules|wintype"); i++) {
@@ -138,20 +194,115 @@ void config_get(const char *config_path) {
 
         const char *wintype_name = cfg_title(cfg_sec);
         wintype window_type = get_wintype_from_name(wintype_name);
-        if (window_type == WINTYPE_UNKNOWN) // TODO put conf file path in error msg
-            eprintf("(TODO conf file path here): wrong wintype '%s' in section 'effect-rules'\n", wintype_name);
+        if (window_type == WINTYPE_UNKNOWN) {
+            fprintf(stderr, "%s: wrong wintype '%s' in section 'effect-rules'\n", path, wintype_name);
+            goto error;
+        }
+        options->corner_radius[window_type] = cfg_getint(cfg_sec, "corner-radius");
 
         for (int j = 0; j < NUM_EVENT_EFFECTS; j++) {
-            char *effect_name = cfg_getstr(cfg_sec, get_event_effect_name(j));
+            const char *effect_name = cfg_getstr(cfg_sec, get_event_effect_name(j));
             if (!effect_name)
                 continue;
-            effect *e = effect_find(effect_name);
-            if (!e) // TODO put conf file path in error msg
-                eprintf("(TODO conf file path here): effect '%s' in section 'wintype %s' is not defined\n",
-                        effect_name, wintype_name);
-            effect_set(window_type, j, e);
-            free(effect_name);
+            effect *e = effect_find(t, effect_name);
+            if (!e) {
+                fprintf(stderr, "%s: effect '%s' in section 'wintype %s' is not defined\n",
+                        path, effect_name, wintype_name);
+                goto error;
+            }
+            effect_set(t, window_type, j, e);
+        }
+    }
+
+    cfg_free(cfg);
+    return t;
+
+error:
+    effect_table_free(t);
+    cfg_free(cfg);
+    return NULL;
+}
+
+static void config_use(effect_table *t, const config_options *options) {
+    s.effect_delta = options->effect_delta;
+    s.damage_hot_rate = options->damage_hot_rate;
+    s.damage_cool_rate = options->damage_cool_rate;
+    s.inactive_dim_step = options->inactive_dim_step;
+    s.frame_governor = options->frame_governor;
+    if (!s.frame_governor)
+        governor_reset();
+    if (s.inactive_dim != options->inactive_dim) {
+        s.inactive_dim = options->inactive_dim;
+        win_dim_all();
+    }
+    if (memcmp(s.corner_radius, options->corner_radius, sizeof(s.corner_radius)) != 0) {
+        memcpy(s.corner_radius, options->corner_radius, sizeof(s.corner_radius));
+        // the regions of the windows exclude their corners
+        s.clip_changed = True;
+        s.visibility_changed = True;
+        for (win *w = s.managed_windows; w; w = w->next)
+            if (w->extents)
+                add_damage(w->extents);
+    }
+    effect_table_use(t);
+}
+
+void config_get(const char *config_path) {
+    config_options options;
+    config_file = config_get_path(config_path);
+
+    effect_table *t = config_parse(config_file, &options);
+    if (!t)
+        exit(EXIT_FAILURE);
+    config_use(t, &options);
+}
+
+void config_reload(void) {
+    config_options options;
+
+    if (!config_file)
+        return;
+
+    effect_table *t = config_parse(config_file, &options);
+    if (!t) {
+        fprintf(stderr, "%s: could not reload configuration, keeping the current one\n", config_file);
+        return;
+    }
+    config_use(t, &options);
+}
+
+int config_watch(void) {
+    if (!config_file)
+        return -1;
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    // editors often replace the file instead of writing to it, so we watch its directory
+    char *dir = strdup(config_file);
+    if (inotify_add_watch(fd, dirname(dir), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    free(dir);
+    return fd;
+}
+
+Bool config_changed(int fd) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char *name = strdup(config_file);
+    const char *file = basename(name);
+    Bool changed = False;
+    ssize_t len;
+
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *) p)->len) {
+            struct inotify_event *ev = (struct inotify_event *) p;
+            if (ev->len && strcmp(ev->name, file) == 0)
+                changed = True;
         }
-        free((void *) wintype_name);
     }
+    free(name);
+    return changed;
 }
@@ -1,3 +1,21 @@
 #pragma once
 
+#include <X11/Xlib.h>
+
 void config_get(const char *config_path);
+
+/*
+ * parses the config file again and swaps in its effects
+ * on errors the current config is kept
+ */
+void config_reload(void);
+
+/*
+ * returns an inotify fd that becomes readable when the config file changes or -1
+ */
+int config_watch(void);
+
+/*
+ * reads the pending events of the config_watch fd, True if one was for the config file
+ */
+Bool config_changed(int fd);
@@ -1,13 +1,14 @@
 #include "effect.h"
+#include "governor.h"
 #include "session.h"
 #include "util.h"
 #include "window.h"
+#include <math.h>
 #include <string.h>
 
 // TODO when an effect is replaced by another, we should clean all effect related variables
 
-static effect *effect_dispatch_table[NUM_WINTYPES][NUM_EVENT_EFFECTS] = {{NULL}};
-static effect *effects;
+static effect_table *current;
 
 static void fade(win *w, double progress, void **effect_data) {
     if (*effect_data == NULL) {
@@ -22,6 +23,10 @@ static void fade(win *w, double progress, void **effect_data) {
 
 static void pop(win *w, double progress, void **effect_data) {
     fade(w, progress, effect_data);
+    if (s.quality >= QUALITY_NO_SCALE) {
+        w->scale = 1.0;
+        return;
+    }
     double lo = 0.75;
     double hi = 1.0;
     w->scale = (progress * (hi - lo)) + lo;
@@ -63,12 +68,52 @@ static void slide_auto(win *w, double progress, void **effect_data) {
     }
 }
 
+/*
+ * move effects, the window starts at the offset action_move gave it and reaches its real position
+ */
+static int *move_start(win *w, void **effect_data) {
+    if (*effect_data == NULL) {
+        int *offset = calloc(2, sizeof(int));
+        offset[0] = w->offset_x;
+        offset[1] = w->offset_y;
+        *effect_data = offset;
+    }
+    return *effect_data;
+}
+
+// the window follows its new position, slowing down as it gets there
+static void lag(win *w, double progress, void **effect_data) {
+    int *offset = move_start(w, effect_data);
+    double k = (1.0 - progress) * (1.0 - progress);
+    w->offset_x = offset[0] * k;
+    w->offset_y = offset[1] * k;
+}
+
+// the window swings around its new position before settling
+static void wobble(win *w, double progress, void **effect_data) {
+    int *offset = move_start(w, effect_data);
+    double k = (1.0 - progress) * cos(progress * 3.0 * M_PI);
+    w->offset_x = offset[0] * k;
+    w->offset_y = offset[1] * k;
+}
+
 effect *effect_get(wintype window_type, event_effect event) {
-    return effect_dispatch_table[window_type][event];
+    if (!current)
+        return NULL;
+    effect *e = current->dispatch_table[window_type][event];
+    if (!e || s.quality < QUALITY_FADE_ONLY || (s.quality == QUALITY_FADE_ONLY && e->func == fade))
+        return e;
+    if (s.quality == QUALITY_NO_ANIMATION || event == EVENT_WINDOW_MAXIMIZE || event == EVENT_WINDOW_MOVE)
+        return NULL;
+
+    // action_set only reads the effect when it starts, one fade can stand in for any of them
+    static effect fade_only = {.name = "fade", .func = fade};
+    fade_only.step = e->step;
+    return &fade_only;
 }
 
-void effect_set(wintype window_type, event_effect event, effect *e) {
-    effect_dispatch_table[window_type][event] = e;
+void effect_set(effect_table *t, wintype window_type, event_effect event, effect *e) {
+    t->dispatch_table[window_type][event] = e;
 }
 
 static const char *event_effect_names[] = {"map-effect", "unmap-effect", "create-effect", "destroy-effect",
@@ -79,8 +124,9 @@ const char *get_event_effect_name(event_effect effect) {
     return event_effect_names[effect];
 }
 
-static const effect_func effect_funcs[] = {fade, pop, slide_auto, slide_up, slide_down, slide_left, slide_right};
-static const char *effect_funcs_names[] = {"fade", "pop", "slide-auto", "slide-up", "slide-down", "slide-left", "slide-right"};
+static const effect_func effect_funcs[] = {fade, pop, slide_auto, slide_up, slide_down, slide_left, slide_right, lag, wobble};
+static const char *effect_funcs_names[] = {"fade", "pop", "slide-auto", "slide-up", "slide-down", "slide-left", "slide-right",
+                                           "lag", "wobble"};
 effect_func get_effect_func_from_name(const char *name) {
     unsigned int size = sizeof(effect_funcs_names) / sizeof(effect_funcs_names[0]);
     for (unsigned int i = 0; i < size; i++)
@@ -89,29 +135,57 @@ effect_func get_effect_func_from_name(const char *name) {
     return NULL;
 }
 
-effect *effect_find(const char *name) {
-    for (effect *e = effects; e; e = e->next) {
+const char *get_effect_func_name(effect_func func) {
+    unsigned int size = sizeof(effect_funcs) / sizeof(effect_funcs[0]);
+    for (unsigned int i = 0; i < size; i++)
+        if (effect_funcs[i] == func)
+            return effect_funcs_names[i];
+    return NULL;
+}
+
+effect_table *effect_table_new(void) {
+    return calloc(1, sizeof(effect_table));
+}
+
+void effect_table_free(effect_table *t) {
+    while (t->effects) {
+        effect *e = t->effects;
+        t->effects = e->next;
+        free((void *) e->name);
+        free(e);
+    }
+    free(t);
+}
+
+void effect_table_use(effect_table *t) {
+    if (current)
+        effect_table_free(current);
+    current = t;
+}
+
+effect *effect_find(effect_table *t, const char *name) {
+    for (effect *e = t->effects; e; e = e->next) {
         if (strcmp(e->name, name) == 0)
             return e;
     }
     return NULL;
 }
 
-void effect_new(const char *name, const char *function_name, double step) {
-    if (effect_find(name))
-        return;
-    effect *e = calloc(1, sizeof(effect));
+effect *effect_new(effect_table *t, const char *name, const char *function_name, double step) {
+    if (effect_find(t, name))
+        return NULL;
 
-    e->func = get_effect_func_from_name(function_name);
-    if (!e->func) {
-        free(e);
-        return;
-    }
-    e->name = name;
+    effect_func func = get_effect_func_from_name(function_name);
+    if (!func)
+        return NULL;
+
+    effect *e = calloc(1, sizeof(effect));
+    e->func = func;
+    e->name = strdup(name);
     e->step = step;
 
-    e->next = effects;
-    effects = e;
+    e->next = t->effects;
+    t->effects = e;
 
-    return;
+    return e;
 }
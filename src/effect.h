@@ -24,14 +24,35 @@ typedef struct _effect {
     double step;
 } effect;
 
+// effects defined in a config and the effect of each wintype/event pair
+typedef struct _effect_table {
+    effect *effects;
+    effect *dispatch_table[NUM_WINTYPES][NUM_EVENT_EFFECTS];
+} effect_table;
+
 effect_func get_effect_func_from_name(const char *name);
 
+const char *get_effect_func_name(effect_func func);
+
 const char *get_event_effect_name(event_effect effect);
 
-effect *effect_find(const char *name);
+effect_table *effect_table_new(void);
+
+void effect_table_free(effect_table *t);
+
+/*
+ * makes t the table effect_get reads from and frees the previous one
+ * running actions keep their effect function and step so they are not affected
+ */
+void effect_table_use(effect_table *t);
+
+effect *effect_find(effect_table *t, const char *name);
 
-void effect_new(const char *name, const char *function_name, double step);
+/*
+ * returns NULL if the function does not exist or an effect with the same name is already defined
+ */
+effect *effect_new(effect_table *t, const char *name, const char *function_name, double step);
 
-void effect_set(wintype window_type, event_effect event, effect *e);
+void effect_set(effect_table *t, wintype window_type, event_effect event, effect *e);
 
 effect *effect_get(wintype window_type, event_effect event);
@@ -0,0 +1,64 @@
+#include "frame.h"
+#include "session.h"
+#include "util.h"
+#include <stdlib.h>
+
+#define ALIGN(size) (((size) + 15) & ~(size_t) 15)
+
+// allocations not fitting in the arena, the arena grows to hold them all at the next reset
+typedef struct _overflow {
+    struct _overflow *next;
+} overflow;
+
+static char *arena = NULL;
+static size_t size_arena = 0, used_arena = 0, needed_arena = 0;
+static overflow *overflows = NULL;
+
+static XserverRegion *regions = NULL;
+static int n_regions = 0, used_regions = 0;
+
+void *frame_alloc(size_t size) {
+    size = ALIGN(size);
+    needed_arena += size;
+    if (used_arena + size <= size_arena) {
+        void *p = arena + used_arena;
+        used_arena += size;
+        return p;
+    }
+
+    overflow *o = malloc(ALIGN(sizeof(overflow)) + size);
+    if (!o)
+        eprintf("out of memory\n");
+    o->next = overflows;
+    overflows = o;
+    return (char *) o + ALIGN(sizeof(overflow));
+}
+
+XserverRegion frame_region(XRectangle *rects, int n) {
+    if (used_regions < n_regions) {
+        XserverRegion region = regions[used_regions++];
+        XFixesSetRegion(s.dpy, region, rects, n);
+        return region;
+    }
+
+    regions = realloc(regions, (n_regions + 1) * sizeof(XserverRegion));
+    regions[n_regions++] = XFixesCreateRegion(s.dpy, rects, n);
+    return regions[used_regions++];
+}
+
+void frame_reset(void) {
+    while (overflows) {
+        overflow *o = overflows;
+        overflows = o->next;
+        free(o);
+    }
+    if (needed_arena > size_arena) {
+        free(arena);
+        size_arena = needed_arena * 2;
+        arena = malloc(size_arena);
+        if (!arena)
+            eprintf("out of memory\n");
+    }
+    used_arena = needed_arena = 0;
+    used_regions = 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xfixes.h>
+#include <stddef.h>
+
+/*
+ * scratch memory valid until frame_reset, it is never freed on its own
+ */
+void *frame_alloc(size_t size);
+
+/*
+ * returns a region valid until frame_reset, it must not be destroyed
+ * the regions of a frame are set again by the next frames instead of being created
+ */
+XserverRegion frame_region(XRectangle *rects, int n);
+
+/*
+ * releases every scratch allocation and region of the frame at once
+ */
+void frame_reset(void);
@@ -0,0 +1,199 @@
+#include "framesync.h"
+#include "session.h"
+#include "util.h"
+#include "window.h"
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/sync.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// a frame a client finished, messages are sent to the window holding the counter
+typedef struct _sync_frame {
+    Window id;
+    int64_t value;     // even counter value the client set
+    uint64_t finished; // when the alarm came, in microseconds
+    uint64_t drawn;
+} sync_frame;
+
+typedef struct _frame_list {
+    sync_frame *frames;
+    int n, size;
+} frame_list;
+
+static Bool has_sync = False;
+static Atom frame_drawn_atom, frame_timings_atom;
+
+static frame_list finished = {0}; // waiting to be painted
+static frame_list drawn = {0};    // painted, waiting to be shown
+
+Bool framesync_init(void) {
+    int major, minor;
+    if (!XSyncQueryExtension(s.dpy, &s.sync_event, &s.sync_error) || !XSyncInitialize(s.dpy, &major, &minor))
+        return False;
+
+    frame_drawn_atom = XInternAtom(s.dpy, "_NET_WM_FRAME_DRAWN", False);
+    frame_timings_atom = XInternAtom(s.dpy, "_NET_WM_FRAME_TIMINGS", False);
+    has_sync = True;
+    return True;
+}
+
+void framesync_watch(win *w, XID counter) {
+    if (!has_sync || counter == w->cold->sync_counter)
+        return;
+
+    framesync_release(w);
+    w->cold->sync_counter = counter;
+    if (!counter)
+        return;
+
+    // one event each time the counter goes up, the wait value follows it by delta
+    XSyncAlarmAttributes attr;
+    attr.trigger.counter = counter;
+    attr.trigger.value_type = XSyncRelative;
+    XSyncIntToValue(&attr.trigger.wait_value, 1);
+    attr.trigger.test_type = XSyncPositiveComparison;
+    XSyncIntToValue(&attr.delta, 1);
+    attr.events = True;
+    // the counter is destroyed with its client
+    set_ignore(NextRequest(s.dpy));
+    w->cold->sync_alarm = XSyncCreateAlarm(s.dpy,
+                                           XSyncCACounter | XSyncCAValueType | XSyncCAValue |
+                                               XSyncCATestType | XSyncCADelta | XSyncCAEvents,
+                                           &attr);
+}
+
+void framesync_update(win *w) {
+    Atom actual;
+    int format;
+    unsigned long n, left;
+
+    unsigned char *data;
+    XID counter = None;
+    set_ignore(NextRequest(s.dpy));
+    int result = XGetWindowProperty(s.dpy, w->cold->props_window_id, s.sync_counter_atom, 0L, 2L, False,
+                                    XA_CARDINAL, &actual, &format,
+                                    &n, &left, &data);
+    if (result == Success && data != NULL) {
+        // the first counter is the basic one handled by the window manager
+        if (n == 2)
+            counter = ((unsigned long *) data)[1];
+        XFree((void *) data);
+    }
+    framesync_watch(w, counter);
+}
+
+void framesync_release(win *w) {
+    if (w->cold->sync_alarm) {
+        XSyncDestroyAlarm(s.dpy, w->cold->sync_alarm);
+        w->cold->sync_alarm = None;
+    }
+    w->cold->sync_counter = None;
+}
+
+static sync_frame *frame_list_add(frame_list *l) {
+    if (l->n == l->size) {
+        l->size = l->size ? l->size * 2 : 8;
+        l->frames = realloc(l->frames, l->size * sizeof(sync_frame));
+        if (!l->frames)
+            eprintf("out of memory\n");
+    }
+    return &l->frames[l->n++];
+}
+
+void framesync_alarm(XSyncAlarmNotifyEvent *ev) {
+    int64_t value = (int64_t) XSyncValueHigh32(ev->counter_value) << 32 | XSyncValueLow32(ev->counter_value);
+    // an odd value means the client started a frame
+    if (value & 1)
+        return;
+
+    win *w;
+    for (w = s.managed_windows; w; w = w->next)
+        if (w->cold->sync_alarm == ev->alarm)
+            break;
+    if (!w)
+        return;
+
+    // a client finishing two frames before a paint only waits for the last one
+    sync_frame *f = NULL;
+    for (int i = 0; i < finished.n && !f; i++)
+        if (finished.frames[i].id == w->cold->props_window_id)
+            f = &finished.frames[i];
+    if (!f)
+        f = frame_list_add(&finished);
+    f->id = w->cold->props_window_id;
+    f->value = value;
+    f->finished = get_ust();
+}
+
+Bool framesync_pending(void) {
+    return finished.n > 0;
+}
+
+static void send_message(Window id, Atom type, long l[5]) {
+    XClientMessageEvent ev = {.type = ClientMessage, .window = id, .message_type = type, .format = 32};
+    for (int i = 0; i < 5; i++)
+        ev.data.l[i] = l[i];
+    // the window may be destroyed already
+    set_ignore(NextRequest(s.dpy));
+    XSendEvent(s.dpy, id, False, NoEventMask, (XEvent *) &ev);
+}
+
+/*
+ * True if the frame of the window held by id is on screen once painted is
+ * a window that is gone or hidden has nothing more to paint
+ */
+static Bool frame_painted(Window id, const XRectangle *painted, int n) {
+    win *w = find_win(id, True);
+    if (!w || w->attr.map_state != IsViewable || !w->cold->visible)
+        return True;
+
+    XRectangle r[2];
+    int n_extents = win_extents_rects(w, r);
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n_extents; j++)
+            if (painted[i].x < r[j].x + r[j].width && r[j].x < painted[i].x + painted[i].width &&
+                painted[i].y < r[j].y + r[j].height && r[j].y < painted[i].y + painted[i].height)
+                return True;
+    return False;
+}
+
+void framesync_drawn(XserverRegion painted) {
+    if (!finished.n)
+        return;
+    // the previous frames were never reported shown, their timings are unknown
+    if (drawn.n)
+        framesync_shown(0, 0);
+
+    int n = 0;
+    XRectangle *rects = painted ? XFixesFetchRegion(s.dpy, painted, &n) : NULL;
+    uint64_t now = get_ust();
+    int kept = 0;
+    for (int i = 0; i < finished.n; i++) {
+        // a window on an output whose frame is not due yet waits for it
+        if (painted && !frame_painted(finished.frames[i].id, rects, n)) {
+            finished.frames[kept++] = finished.frames[i];
+            continue;
+        }
+        sync_frame *f = frame_list_add(&drawn);
+        *f = finished.frames[i];
+        f->drawn = now;
+        long l[5] = {f->value & 0xffffffff, f->value >> 32, now & 0xffffffff, now >> 32, 0};
+        send_message(f->id, frame_drawn_atom, l);
+    }
+    finished.n = kept;
+    if (rects)
+        XFree(rects);
+}
+
+void framesync_shown(uint64_t ust, uint64_t refresh_interval) {
+    for (int i = 0; i < drawn.n; i++) {
+        sync_frame *f = &drawn.frames[i];
+        // offset of the presentation from the drawn time, 0x80000000 when unknown
+        long offset = ust ? (long) (int32_t) (ust - f->drawn) : 0x80000000L;
+        long l[5] = {f->value & 0xffffffff, f->value >> 32, offset, refresh_interval, f->drawn - f->finished};
+        send_message(f->id, frame_timings_atom, l);
+    }
+    drawn.n = 0;
+}
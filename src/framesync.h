@@ -0,0 +1,53 @@
+#pragma once
+
+#include "window.h"
+#include <X11/Xlib.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/sync.h>
+#include <stdint.h>
+
+/*
+ * compositor side of the extended _NET_WM_SYNC_REQUEST protocol
+ * a client sets its extended counter to an even value when it finished drawing a frame,
+ * compix answers with _NET_WM_FRAME_DRAWN once the frame is painted and _NET_WM_FRAME_TIMINGS
+ * once it is on screen, the client waits for them instead of drawing frames that are never shown
+ */
+
+/*
+ * queries the Sync extension, returns False if it is missing and frames are then never synced
+ */
+Bool framesync_init(void);
+
+/*
+ * watches the extended counter of w, None stops watching
+ */
+void framesync_watch(win *w, XID counter);
+
+/*
+ * reads _NET_WM_SYNC_REQUEST_COUNTER again after it changed
+ */
+void framesync_update(win *w);
+
+void framesync_release(win *w);
+
+/*
+ * the counter of a window changed, an even value is a finished frame
+ */
+void framesync_alarm(XSyncAlarmNotifyEvent *ev);
+
+/*
+ * True if a finished frame waits for framesync_drawn
+ */
+Bool framesync_pending(void);
+
+/*
+ * sends _NET_WM_FRAME_DRAWN for the finished frames of the windows painted covers, the others keep waiting
+ * None reports every finished frame, when nothing is left to paint
+ */
+void framesync_drawn(XserverRegion painted);
+
+/*
+ * sends _NET_WM_FRAME_TIMINGS for the frames of the last framesync_drawn
+ * ust is when they were shown in microseconds and refresh_interval the time between two vblanks, 0 when unknown
+ */
+void framesync_shown(uint64_t ust, uint64_t refresh_interval);
@@ -0,0 +1,71 @@
+#include "governor.h"
+#include "output.h"
+#include "session.h"
+#include "util.h"
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <stdio.h>
+
+#define LOWER_DELAY 250  // milliseconds at a level before it is lowered again
+#define RAISE_DELAY 2000 // milliseconds of cheap frames before the level is raised
+
+static const char *quality_names[] = {"full", "fast filter", "no scale", "fade only", "no animation"};
+
+static Atom quality_atom;
+static uint64_t average = 0; // frame duration in microseconds, smoothed over the last frames
+static int last_change = 0;
+static int cheap_since = 0;  // 0 when the last frame was not cheap
+
+static void set_quality(quality q) {
+    s.quality = q;
+    last_change = get_time_in_milliseconds();
+
+    long value = q;
+    XChangeProperty(s.dpy, s.root, quality_atom, XA_CARDINAL, 32, PropModeReplace, (unsigned char *) &value, 1);
+}
+
+void governor_init(void) {
+    quality_atom = XInternAtom(s.dpy, "_COMPIX_QUALITY", False);
+    long value = s.quality;
+    XChangeProperty(s.dpy, s.root, quality_atom, XA_CARDINAL, 32, PropModeReplace, (unsigned char *) &value, 1);
+}
+
+void governor_frame(uint64_t duration) {
+    if (!s.frame_governor)
+        return;
+
+    uint64_t budget = output_frame_budget() * 1000;
+    // a single slow frame (a window mapping) does not lower the quality on its own
+    average = average ? (average * 7 + duration) / 8 : duration;
+    int now = get_time_in_milliseconds();
+
+    if (average > budget) {
+        cheap_since = 0;
+        if (s.quality < NUM_QUALITIES - 1 && now - last_change >= LOWER_DELAY) {
+            set_quality(s.quality + 1);
+            fprintf(stderr, "frames take %luus for a budget of %luus, quality lowered to %s\n",
+                    (unsigned long) average, (unsigned long) budget, quality_names[s.quality]);
+        }
+    } else if (average < budget / 2) {
+        // time without frames counts as cheap, the screen may be idle at a low level
+        if (!cheap_since)
+            cheap_since = now;
+        if (s.quality > QUALITY_FULL && now - cheap_since >= RAISE_DELAY && now - last_change >= RAISE_DELAY) {
+            set_quality(s.quality - 1);
+            cheap_since = now;
+            fprintf(stderr, "frames take %luus for a budget of %luus, quality raised to %s\n",
+                    (unsigned long) average, (unsigned long) budget, quality_names[s.quality]);
+        }
+    } else {
+        cheap_since = 0;
+    }
+}
+
+void governor_reset(void) {
+    average = 0;
+    cheap_since = 0;
+    if (s.quality != QUALITY_FULL) {
+        set_quality(QUALITY_FULL);
+        fprintf(stderr, "frame governor off, quality set to %s\n", quality_names[s.quality]);
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <X11/Xlib.h>
+#include <stdint.h>
+
+/*
+ * the governor compares the time spent on each frame with the refresh interval of the outputs
+ * over budget it lowers the quality one level at a time, it raises it back once frames are cheap
+ * the level is published as the CARDINAL _COMPIX_QUALITY on the root window
+ */
+
+// each level also applies the ones before it
+typedef enum _quality {
+    QUALITY_FULL,
+    QUALITY_FAST_FILTER,  // scaled windows are not antialiased
+    QUALITY_NO_SCALE,     // effects don't scale windows (pop)
+    QUALITY_FADE_ONLY,    // map, unmap and desktop change effects fade, the others are off
+    QUALITY_NO_ANIMATION, // no new effect is started
+    NUM_QUALITIES
+} quality;
+
+void governor_init(void);
+
+/*
+ * duration is the time in microseconds spent painting a frame
+ */
+void governor_frame(uint64_t duration);
+
+/*
+ * goes back to full quality, when the governor is turned off
+ */
+void governor_reset(void);
@@ -0,0 +1,218 @@
+#include "handoff.h"
+#include "action.h"
+#include "framesync.h"
+#include "session.h"
+#include "util.h"
+#include "window.h"
+#include <X11/Xlib.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HANDOFF_MAGIC 0x48585043 // "CPXH"
+#define HANDOFF_VERSION 4        // bump when handoff_record changes
+#define HANDOFF_TIMEOUT 5000     // milliseconds the running instance waits for the next one to redirect
+
+typedef struct _handoff_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+} handoff_header;
+
+// only mapped windows are written, the others are managed from scratch
+typedef struct _handoff_record {
+    uint32_t id;
+    uint32_t props_window_id;
+    int32_t window_type;
+    uint32_t state;
+    int32_t desktop;
+    uint32_t sync_counter;
+    double opacity; // once the running effect is over
+    double dim;
+    uint8_t damaged;
+    uint8_t has_action;
+    char effect[16];
+    double progress;
+    double end;
+    double step;
+} handoff_record;
+
+static handoff_record *records = NULL;
+static uint32_t n_records = 0;
+static Bool found = False; // a table was there, it is deleted once the windows are redirected
+
+static const char *handoff_path(void) {
+    return runtime_path("handoff");
+}
+
+/*
+ * the directory may be /tmp, a file or link planted under the same name is never followed
+ */
+static FILE *handoff_create(const char *path) {
+    unlink(path);
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+    if (fd < 0)
+        return NULL;
+    return fdopen(fd, "w");
+}
+
+static FILE *handoff_open(const char *path, off_t *size) {
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_NOFOLLOW);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) || st.st_uid != getuid() || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return NULL;
+    }
+    *size = st.st_size;
+    return fdopen(fd, "r");
+}
+
+Bool handoff_save(void) {
+    handoff_header header = {.magic = HANDOFF_MAGIC, .version = HANDOFF_VERSION, .count = 0};
+    FILE *f = handoff_create(handoff_path());
+    if (!f) {
+        fprintf(stderr, "cannot write the handoff file %s\n", handoff_path());
+        return False;
+    }
+
+    for (win *w = s.managed_windows; w; w = w->next)
+        if (w->attr.map_state == IsViewable)
+            header.count++;
+    fwrite(&header, sizeof(header), 1, f);
+
+    // top to bottom, the order does not matter as the next instance restacks from the tree
+    for (win *w = s.managed_windows; w; w = w->next) {
+        if (w->attr.map_state != IsViewable)
+            continue;
+
+        handoff_record r = {
+            .id = w->id,
+            .props_window_id = w->cold->props_window_id,
+            .window_type = w->cold->window_type,
+            .state = w->cold->state,
+            .desktop = w->cold->desktop,
+            .sync_counter = w->cold->sync_counter,
+            .opacity = w->opacity,
+            .dim = w->dim,
+            .damaged = w->damaged};
+        action_state a;
+        if (action_get_state(w, &a)) {
+            r.has_action = True;
+            strncpy(r.effect, a.effect, sizeof(r.effect) - 1);
+            r.progress = a.progress;
+            r.end = a.end;
+            r.step = a.step;
+            r.opacity = a.opacity;
+        }
+        fwrite(&r, sizeof(r), 1, f);
+    }
+    fclose(f);
+    return True;
+}
+
+void handoff_wait_taken(void) {
+    const char *path = handoff_path();
+    int deadline = get_time_in_milliseconds() + HANDOFF_TIMEOUT;
+    struct timespec delay = {.tv_sec = 0, .tv_nsec = 10 * 1000000};
+
+    while (access(path, F_OK) == 0) {
+        if (get_time_in_milliseconds() > deadline) {
+            fprintf(stderr, "the next compix did not take over the windows, they will be redirected again\n");
+            unlink(path);
+            return;
+        }
+        nanosleep(&delay, NULL);
+    }
+}
+
+Bool handoff_load(void) {
+    handoff_header header;
+    const char *path = handoff_path();
+    off_t size;
+    FILE *f = handoff_open(path, &size);
+    if (!f)
+        return False;
+    found = True;
+
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        header.magic != HANDOFF_MAGIC || header.version != HANDOFF_VERSION) {
+        fprintf(stderr, "%s: unknown handoff format, managing every window again\n", path);
+        fclose(f);
+        return False;
+    }
+
+    // the count comes from the file, it can not claim more records than the file holds
+    if (header.count > (size - sizeof(header)) / sizeof(handoff_record)) {
+        fprintf(stderr, "%s: truncated handoff, managing every window again\n", path);
+        fclose(f);
+        return False;
+    }
+    records = malloc(header.count * sizeof(handoff_record));
+    if (header.count && !records) {
+        fprintf(stderr, "%s: out of memory reading the handoff, managing every window again\n", path);
+        fclose(f);
+        return False;
+    }
+    n_records = fread(records, sizeof(handoff_record), header.count, f);
+    fclose(f);
+    // the effect name is looked up with strcmp
+    for (uint32_t i = 0; i < n_records; i++)
+        records[i].effect[sizeof(records[i].effect) - 1] = '\0';
+    return True;
+}
+
+static handoff_record *handoff_find(Window id) {
+    for (uint32_t i = 0; i < n_records; i++)
+        if (records[i].id == id)
+            return &records[i];
+    return NULL;
+}
+
+Bool handoff_known(Window id) {
+    return handoff_find(id) != NULL;
+}
+
+void handoff_adopt(win *w) {
+    handoff_record *r = handoff_find(w->id);
+
+    w->attr.map_state = IsViewable;
+    w->cold->props_window_id = r->props_window_id;
+    w->cold->window_type = r->window_type;
+    w->cold->state = r->state;
+    w->cold->desktop = r->desktop;
+    framesync_watch(w, r->sync_counter);
+    XSelectInput(s.dpy, w->cold->props_window_id, PropertyChangeMask);
+
+    w->opacity = r->opacity;
+    // kept as it is, update_active_window fades it if the active window is another one by now
+    w->dim = w->cold->dim_target = r->dim;
+    determine_mode(w);
+    // the pixmap was already painted, no damage will come until the window draws again
+    w->damaged = r->damaged;
+
+    if (r->has_action) {
+        action_state a = {.effect = r->effect, .progress = r->progress, .end = r->end, .step = r->step};
+        action_set_state(w, &a);
+    }
+    s.visibility_changed = True;
+}
+
+void handoff_clear(void) {
+    free(records);
+    records = NULL;
+    n_records = 0;
+
+    if (found) {
+        // the previous instance keeps the windows redirected until the file is gone
+        XSync(s.dpy, False);
+        unlink(handoff_path());
+        found = False;
+    }
+}
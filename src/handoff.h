@@ -0,0 +1,46 @@
+#pragma once
+
+#include "window.h"
+#include <X11/Xlib.h>
+
+/*
+ * hands the window table over to a compix started with -r, so that it does not fetch
+ * the properties of every window again nor replay the map effects
+ * the table is written to a file in $XDG_RUNTIME_DIR (or /tmp) named after the display
+ *
+ * a redirection is freed with the connection of its client, so the running instance redirects
+ * the windows automatically and waits for the next one to redirect them before it exits
+ * the next instance deletes the file once it did, which tells the running one to exit
+ */
+
+/*
+ * writes the window table, called by the running instance when it loses the manager selection
+ * returns False if the file could not be created
+ */
+Bool handoff_save(void);
+
+/*
+ * waits until the next instance redirected the windows and deleted the table, or gave up
+ */
+void handoff_wait_taken(void);
+
+/*
+ * reads the table written by the previous instance, False if there is none
+ */
+Bool handoff_load(void);
+
+/*
+ * True if the previous instance painted id while it was mapped, w then takes over its state
+ * the properties of id don't need to be fetched
+ */
+Bool handoff_known(Window id);
+
+/*
+ * takes over the state of a window mapped in the previous instance instead of mapping it
+ */
+void handoff_adopt(win *w);
+
+/*
+ * frees the table and deletes its file, the windows must be redirected by then
+ */
+void handoff_clear(void);
@@ -0,0 +1,70 @@
+#include "ingest.h"
+#include "session.h"
+#include "util.h"
+#include <X11/Xlib.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * the thread appends to queue while session_loop handles the events of taken
+ * so reading the connection never waits for a frame to be painted
+ */
+typedef struct _event_buffer {
+    XEvent *events;
+    int n;
+    int size;
+} event_buffer;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static event_buffer queue, taken;
+static int wake[2]; // written when queue stops being empty
+
+static void *ingest(void *arg) {
+    for (;;) {
+        XEvent ev;
+        // blocks with the display unlocked, the other thread keeps sending requests meanwhile
+        XNextEvent(s.dpy, &ev);
+        // the data of a generic event is freed by the next XNextEvent unless read now
+        if (ev.type == GenericEvent)
+            XGetEventData(s.dpy, &ev.xcookie);
+
+        pthread_mutex_lock(&lock);
+        if (queue.n == queue.size)
+            queue.events = realloc(queue.events, (queue.size = queue.size ? queue.size * 2 : 64) * sizeof(XEvent));
+        queue.events[queue.n++] = ev;
+        if (queue.n == 1)
+            write(wake[1], "", 1);
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+int ingest_start(void) {
+    pthread_t thread;
+
+    if (pipe(wake) < 0)
+        eprintf("cannot create the event pipe\n");
+    fcntl(wake[0], F_SETFL, O_NONBLOCK);
+    if (pthread_create(&thread, NULL, ingest, NULL) != 0)
+        eprintf("cannot start the event thread\n");
+    pthread_detach(thread);
+    return wake[0];
+}
+
+int ingest_take(XEvent **events) {
+    char buf[16];
+
+    pthread_mutex_lock(&lock);
+    while (read(wake[0], buf, sizeof(buf)) > 0)
+        ;
+    event_buffer tmp = taken;
+    taken = queue;
+    queue = tmp;
+    queue.n = 0;
+    pthread_mutex_unlock(&lock);
+
+    *events = taken.events;
+    return taken.n;
+}
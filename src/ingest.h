@@ -0,0 +1,15 @@
+#pragma once
+
+#include <X11/Xlib.h>
+
+/*
+ * starts the thread reading the X events as they arrive, XInitThreads must have been called
+ * returns a file descriptor readable when events are waiting to be taken
+ */
+int ingest_start(void);
+
+/*
+ * takes every event read since the last call without blocking, returns their count
+ * events stays valid until the next call, generic events come with their data already read
+ */
+int ingest_take(XEvent **events);
@@ -0,0 +1,147 @@
+#include "output.h"
+#include "frame.h"
+#include "session.h"
+#include "util.h"
+#include <X11/Xlib.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/Xrandr.h>
+#include <stdlib.h>
+
+static output *outputs;
+static Bool has_randr = False;
+
+static int mode_frame_interval(XRRScreenResources *res, RRMode id) {
+    for (int i = 0; i < res->nmode; i++) {
+        XRRModeInfo *m = &res->modes[i];
+        if (m->id != id)
+            continue;
+
+        double vtotal = m->vTotal;
+        if (m->modeFlags & RR_DoubleScan)
+            vtotal *= 2;
+        if (m->modeFlags & RR_Interlace)
+            vtotal /= 2;
+        if (!m->dotClock || !m->hTotal || !vtotal)
+            return 0;
+        return 1000.0 * m->hTotal * vtotal / m->dotClock;
+    }
+    return 0;
+}
+
+static void output_add(int x, int y, int width, int height, int frame_interval) {
+    output *o = malloc(sizeof(output));
+    o->geometry.x = x;
+    o->geometry.y = y;
+    o->geometry.width = width;
+    o->geometry.height = height;
+    o->frame_interval = frame_interval;
+    o->next_frame = 0;
+    o->damage = XFixesCreateRegion(s.dpy, &o->geometry, 1);
+    o->damaged = True;
+
+    o->next = outputs;
+    outputs = o;
+}
+
+static void output_clear(void) {
+    while (outputs) {
+        output *o = outputs;
+        outputs = o->next;
+        XFixesDestroyRegion(s.dpy, o->damage);
+        free(o);
+    }
+}
+
+void output_update(void) {
+    output_clear();
+
+    if (has_randr) {
+        XRRScreenResources *res = XRRGetScreenResourcesCurrent(s.dpy, s.root);
+        for (int i = 0; res && i < res->ncrtc; i++) {
+            XRRCrtcInfo *crtc = XRRGetCrtcInfo(s.dpy, res, res->crtcs[i]);
+            if (crtc && crtc->mode != None && crtc->width && crtc->height)
+                output_add(crtc->x, crtc->y, crtc->width, crtc->height, mode_frame_interval(res, crtc->mode));
+            if (crtc)
+                XRRFreeCrtcInfo(crtc);
+        }
+        if (res)
+            XRRFreeScreenResources(res);
+    }
+
+    // disabled CRTCs (or no RandR): paint the root like a single output
+    if (!outputs)
+        output_add(0, 0, s.root_width, s.root_height, 0);
+}
+
+void output_init(void) {
+    has_randr = XRRQueryExtension(s.dpy, &s.xrandr_event, &s.xrandr_error);
+    if (has_randr)
+        XRRSelectInput(s.dpy, s.root, RRScreenChangeNotifyMask);
+    output_update();
+}
+
+static void damage_output(output *o, XserverRegion part) {
+    if (o->damaged)
+        XFixesUnionRegion(s.dpy, o->damage, o->damage, part);
+    else
+        XFixesCopyRegion(s.dpy, o->damage, part);
+    o->damaged = True;
+}
+
+void output_add_damage(XserverRegion damage) {
+    // a single output takes the whole damage
+    if (!outputs->next) {
+        damage_output(outputs, damage);
+        return;
+    }
+
+    // split on the server without a round-trip, an output outside of the damage then paints an empty frame
+    XserverRegion part = frame_region(NULL, 0);
+    for (output *o = outputs; o; o = o->next) {
+        XFixesSetRegion(s.dpy, part, &o->geometry, 1);
+        XFixesIntersectRegion(s.dpy, part, part, damage);
+        damage_output(o, part);
+    }
+}
+
+int output_timeout(void) {
+    int now = get_time_in_milliseconds();
+    int timeout = -1;
+
+    for (output *o = outputs; o; o = o->next) {
+        if (!o->damaged)
+            continue;
+        int delta = o->next_frame - now;
+        if (delta < 0)
+            delta = 0;
+        if (timeout < 0 || delta < timeout)
+            timeout = delta;
+    }
+    return timeout;
+}
+
+int output_frame_budget(void) {
+    int budget = 0;
+    for (output *o = outputs; o; o = o->next)
+        if (o->frame_interval && (!budget || o->frame_interval < budget))
+            budget = o->frame_interval;
+    // 60Hz when no refresh rate is known
+    return budget ? budget : 16;
+}
+
+XserverRegion output_take_damage(void) {
+    int now = get_time_in_milliseconds();
+    XserverRegion damage = None;
+
+    for (output *o = outputs; o; o = o->next) {
+        if (!o->damaged || o->next_frame - now > 0)
+            continue;
+        if (!damage)
+            damage = frame_region(NULL, 0);
+        XFixesUnionRegion(s.dpy, damage, damage, o->damage);
+        XFixesSetRegion(s.dpy, o->damage, NULL, 0);
+        o->damaged = False;
+        o->next_frame = now + o->frame_interval;
+    }
+    return damage;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xfixes.h>
+
+// a CRTC showing part of the root window, painted at its own refresh rate
+typedef struct _output {
+    struct _output *next;
+    XRectangle geometry;
+    int frame_interval;   // in milliseconds, 0 paints as soon as damaged
+    int next_frame;       // time before which the output is not painted again
+    XserverRegion damage; // waiting for the next frame of the output, emptied rather than destroyed
+    Bool damaged;
+} output;
+
+/*
+ * selects RandR screen change events and discovers the outputs
+ * without RandR, the whole root is a single output painted as soon as damaged
+ */
+void output_init(void);
+
+/*
+ * discovers the outputs again after a hotplug or a root resize, every output is damaged
+ */
+void output_update(void);
+
+/*
+ * splits damage between the outputs without a round-trip, damage is left to the caller
+ * with several outputs each one is damaged, possibly by an empty part
+ */
+void output_add_damage(XserverRegion damage);
+
+/*
+ * returns the time in milliseconds until a damaged output has to be painted, -1 if none is damaged
+ */
+int output_timeout(void);
+
+/*
+ * the shortest refresh interval of the outputs in milliseconds, the time a frame may take
+ */
+int output_frame_budget(void);
+
+/*
+ * returns the damage of the outputs whose frame is due as a frame region or None
+ * their next frame is scheduled
+ */
+XserverRegion output_take_damage(void);
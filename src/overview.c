@@ -0,0 +1,69 @@
+#include "overview.h"
+#include "frame.h"
+#include "render.h"
+#include "session.h"
+#include "thumbnail.h"
+#include "window.h"
+#include <math.h>
+#include <stdio.h>
+
+#define OVERVIEW_GAP 32 // pixels around each thumbnail
+
+static Bool overview_shows(win *w) {
+    return w->attr.map_state == IsViewable && w->damaged && w->attr.class == InputOutput &&
+           (w->cold->window_type == WINTYPE_NORMAL || w->cold->window_type == WINTYPE_DIALOG);
+}
+
+void overview_message(XClientMessageEvent *ev) {
+    Bool overview = ev->data.l[0] == 2 ? !s.overview : ev->data.l[0] != 0;
+    if (overview == s.overview)
+        return;
+    if (overview && !render_pictures()) {
+        fprintf(stderr, "the overview is only supported by the xrender backend\n");
+        return;
+    }
+
+    s.overview = overview;
+    XRectangle screen = {0, 0, s.root_width, s.root_height};
+    add_damage(frame_region(&screen, 1));
+}
+
+void overview_paint(Picture dest) {
+    int n = 0;
+    for (win *w = s.managed_windows; w; w = w->next)
+        if (overview_shows(w))
+            n++;
+    if (!n)
+        return;
+
+    int cols = ceil(sqrt(n));
+    int rows = (n + cols - 1) / cols;
+    int cell_width = s.root_width / cols;
+    int cell_height = s.root_height / rows;
+
+    // the topmost window comes first
+    int i = 0;
+    for (win *w = s.managed_windows; w; w = w->next) {
+        if (!overview_shows(w))
+            continue;
+
+        int width = w->attr.width + w->attr.border_width * 2;
+        int height = w->attr.height + w->attr.border_width * 2;
+        double scale = 1.0;
+        if ((double) (cell_width - OVERVIEW_GAP) / width < scale)
+            scale = (double) (cell_width - OVERVIEW_GAP) / width;
+        if ((double) (cell_height - OVERVIEW_GAP) / height < scale)
+            scale = (double) (cell_height - OVERVIEW_GAP) / height;
+        width *= scale;
+        height *= scale;
+
+        Picture thumbnail = thumbnail_get(w, width, height);
+        if (thumbnail) {
+            int x = (i % cols) * cell_width + (cell_width - width) / 2;
+            int y = (i / cols) * cell_height + (cell_height - height) / 2;
+            XRenderComposite(s.dpy, PictOpOver, thumbnail, None, dest,
+                             0, 0, 0, 0, x, y, width, height);
+        }
+        i++;
+    }
+}
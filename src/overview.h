@@ -0,0 +1,17 @@
+#pragma once
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrender.h>
+
+/*
+ * the overview lays out the thumbnails of the application windows in a grid over the whole screen
+ * it is toggled by a _COMPIX_OVERVIEW client message sent to the root with SubstructureNotifyMask,
+ * data.l[0] is 0 to leave it, 1 to enter it and 2 to toggle it
+ */
+
+void overview_message(XClientMessageEvent *ev);
+
+/*
+ * paints the thumbnails over dest, called for every frame while the overview is shown
+ */
+void overview_paint(Picture dest);
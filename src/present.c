@@ -0,0 +1,92 @@
+#include "present.h"
+#include "framesync.h"
+#include "governor.h"
+#include "render.h"
+#include "session.h"
+#include "util.h"
+#include <X11/Xlib.h>
+#include <X11/extensions/Xpresent.h>
+#include <stdint.h>
+#include <stdio.h>
+
+static Window target;
+static int present_opcode;
+static uint32_t frame_serial = 0;
+static Bool complete_pending = False;
+static Bool idle_pending = False;
+
+// timing feedback of the last completed frame, ust in microseconds
+static uint64_t submit_ust = 0;
+static uint64_t last_ust = 0, last_msc = 0;
+static uint64_t refresh_interval = 0; // measured from consecutive completions
+static uint64_t present_latency = 0;  // from XPresentPixmap to the frame being on screen
+
+Bool present_init(void) {
+    int event_base, error_base;
+    if (!XPresentQueryExtension(s.dpy, &present_opcode, &event_base, &error_base))
+        return False;
+
+    target = overlay_get();
+    XPresentSelectInput(s.dpy, target, PresentCompleteNotifyMask | PresentIdleNotifyMask);
+    return True;
+}
+
+void present_frame(Pixmap pixmap, XserverRegion update) {
+    submit_ust = get_ust();
+    complete_pending = idle_pending = True;
+    // copy so the server never keeps the pixmap for a flip, it is drawn to again on the next frame
+    XPresentPixmap(s.dpy, target, pixmap, ++frame_serial, None, update, 0, 0,
+                   None, None, None, PresentOptionCopy, 0, 0, 0, NULL, 0);
+    XFlush(s.dpy);
+}
+
+Bool present_busy(void) {
+    return complete_pending || idle_pending;
+}
+
+static void present_complete(XPresentCompleteNotifyEvent *ev) {
+    if (ev->serial_number != frame_serial || ev->kind != PresentCompleteKindPixmap)
+        return;
+
+    /*
+     * a frame on time completes at the first vblank after it was submitted, its server side fit in the budget
+     * a later one missed vblanks, the governor is given its whole latency
+     */
+    uint64_t late = ev->ust - submit_ust;
+    if (refresh_interval && last_ust && submit_ust > last_ust) {
+        uint64_t first = last_ust + ((submit_ust - last_ust) / refresh_interval + 1) * refresh_interval;
+        if (ev->ust < first + refresh_interval / 2)
+            late = 0;
+    }
+
+    if (last_msc && ev->msc > last_msc)
+        refresh_interval = (ev->ust - last_ust) / (ev->msc - last_msc);
+    present_latency = ev->ust - submit_ust;
+    last_ust = ev->ust;
+    last_msc = ev->msc;
+    complete_pending = False;
+    framesync_shown(ev->ust, refresh_interval);
+    governor_frame(late);
+
+#ifdef DEBUG
+    printf("[Present] serial: %u, msc: %lu, refresh: %luus, latency: %luus\n",
+           ev->serial_number, (unsigned long) ev->msc, (unsigned long) refresh_interval, (unsigned long) present_latency);
+#endif
+}
+
+Bool present_event(XGenericEventCookie *cookie) {
+    if (cookie->extension != present_opcode)
+        return False;
+    if (!cookie->data)
+        return True;
+
+    if (cookie->evtype == PresentCompleteNotify) {
+        present_complete(cookie->data);
+    } else if (cookie->evtype == PresentIdleNotify) {
+        XPresentIdleNotifyEvent *ev = cookie->data;
+        if (ev->serial_number == frame_serial)
+            idle_pending = False;
+    }
+    XFreeEventData(s.dpy, cookie);
+    return True;
+}
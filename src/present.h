@@ -0,0 +1,27 @@
+#pragma once
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xfixes.h>
+
+/*
+ * sets up presenting frames to the overlay window with the Present extension
+ * returns False if the extension is missing
+ */
+Bool present_init(void);
+
+/*
+ * presents the update region of pixmap at the next vblank
+ * the pixmap must not be drawn to until present_busy returns False
+ */
+void present_frame(Pixmap pixmap, XserverRegion update);
+
+/*
+ * True while the last frame is not on screen or its pixmap is still read by the server
+ */
+Bool present_busy(void);
+
+/*
+ * handles a generic event whose data was read, returns False if it is not a Present event
+ * the data of a Present event is freed
+ */
+Bool present_event(XGenericEventCookie *cookie);
@@ -0,0 +1,156 @@
+#include "props.h"
+#include "session.h"
+#include "util.h"
+#include "window.h"
+#include <X11/Xlib-xcb.h>
+#include <X11/Xlib.h>
+#include <stdlib.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+/*
+ * property requests of a window whose replies have not been read yet
+ * every request of map_win is sent at once so a batch of windows costs a single round-trip
+ */
+typedef struct _prop_fetch {
+    struct _prop_fetch *next;
+    Window id;
+    xcb_list_properties_cookie_t list;
+    xcb_get_property_cookie_t wintype;
+    xcb_get_property_cookie_t transient_for;
+    xcb_get_property_cookie_t opacity;
+    xcb_get_property_cookie_t desktop;
+    xcb_get_property_cookie_t sync_counter;
+} prop_fetch;
+
+static prop_fetch *pending;
+
+static prop_fetch *prop_fetch_find(Window id) {
+    for (prop_fetch *f = pending; f; f = f->next)
+        if (f->id == id)
+            return f;
+    return NULL;
+}
+
+static prop_fetch *prop_fetch_send(Window id) {
+    xcb_connection_t *c = XGetXCBConnection(s.dpy);
+    prop_fetch *f = malloc(sizeof(prop_fetch));
+
+    f->id = id;
+    f->list = xcb_list_properties(c, id);
+    // s.wintype_atoms[NUM_WINTYPES] is the _NET_WM_WINDOW_TYPE atom used to query a window type
+    f->wintype = xcb_get_property(c, False, id, s.wintype_atoms[NUM_WINTYPES], XCB_ATOM_ATOM, 0, 1);
+    f->transient_for = xcb_get_property(c, False, id, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 0, 1);
+    f->opacity = xcb_get_property(c, False, id, s.opacity_atom, XCB_ATOM_CARDINAL, 0, 1);
+    f->desktop = xcb_get_property(c, False, id, s.wm_desktop_atom, XCB_ATOM_CARDINAL, 0, 1);
+    f->sync_counter = xcb_get_property(c, False, id, s.sync_counter_atom, XCB_ATOM_CARDINAL, 0, 2);
+
+    f->next = pending;
+    pending = f;
+    return f;
+}
+
+static void prop_fetch_unlink(prop_fetch *f) {
+    for (prop_fetch **prev = &pending; *prev; prev = &(*prev)->next) {
+        if (*prev == f) {
+            *prev = f->next;
+            break;
+        }
+    }
+}
+
+/*
+ * reads a get property reply, errors (window already destroyed) are dropped silently
+ */
+static xcb_get_property_reply_t *get_property_reply(xcb_get_property_cookie_t cookie, xcb_atom_t type) {
+    xcb_generic_error_t *e = NULL;
+    xcb_get_property_reply_t *r = xcb_get_property_reply(XGetXCBConnection(s.dpy), cookie, &e);
+    free(e);
+    if (r && (r->type != type || !xcb_get_property_value_length(r))) {
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+/*
+ * waits for the replies of f, fills props and frees f
+ */
+static void prop_fetch_collect(prop_fetch *f, win_props *props) {
+    xcb_generic_error_t *e = NULL;
+    xcb_list_properties_reply_t *list = xcb_list_properties_reply(XGetXCBConnection(s.dpy), f->list, &e);
+    free(e);
+    xcb_get_property_reply_t *wintype = get_property_reply(f->wintype, XCB_ATOM_ATOM);
+    xcb_get_property_reply_t *transient_for = get_property_reply(f->transient_for, XCB_ATOM_WINDOW);
+    xcb_get_property_reply_t *opacity = get_property_reply(f->opacity, XCB_ATOM_CARDINAL);
+    xcb_get_property_reply_t *desktop = get_property_reply(f->desktop, XCB_ATOM_CARDINAL);
+    xcb_get_property_reply_t *sync_counter = get_property_reply(f->sync_counter, XCB_ATOM_CARDINAL);
+
+    // some programs do not put their properties on their window (see xterm)
+    props->props_window_id = list && list->atoms_len ? f->id : None;
+
+    props->window_type = WINTYPE_UNKNOWN;
+    props->opacity = 1.0;
+    props->desktop = -1;
+    props->sync_counter = None;
+    if (props->props_window_id) {
+        if (wintype) {
+            Atom a = *(xcb_atom_t *) xcb_get_property_value(wintype);
+            for (int i = 0; i < NUM_WINTYPES; i++)
+                if (s.wintype_atoms[i] == a)
+                    props->window_type = i;
+        }
+        if (opacity)
+            props->opacity = (double) *(uint32_t *) xcb_get_property_value(opacity) / OPAQUE;
+        if (desktop)
+            props->desktop = *(uint32_t *) xcb_get_property_value(desktop);
+        // the first counter is the basic one, only the window manager uses it
+        if (sync_counter && xcb_get_property_value_length(sync_counter) == 2 * sizeof(uint32_t))
+            props->sync_counter = ((uint32_t *) xcb_get_property_value(sync_counter))[1];
+    }
+    if (props->window_type == WINTYPE_UNKNOWN)
+        props->window_type = transient_for ? WINTYPE_DIALOG : WINTYPE_NORMAL;
+
+    free(list);
+    free(wintype);
+    free(transient_for);
+    free(opacity);
+    free(desktop);
+    free(sync_counter);
+    free(f);
+}
+
+void props_prefetch(Window id) {
+    if (!prop_fetch_find(id))
+        prop_fetch_send(id);
+}
+
+void props_prefetch_events(XEvent *events, int n) {
+    for (int i = 0; i < n; i++)
+        if (events[i].type == MapNotify)
+            props_prefetch(events[i].xmap.window);
+}
+
+void props_get(Window id, win_props *props) {
+    prop_fetch *f = prop_fetch_find(id);
+    if (f)
+        prop_fetch_unlink(f);
+    else
+        f = prop_fetch_send(id);
+    prop_fetch_collect(f, props);
+}
+
+void props_clear(void) {
+    xcb_connection_t *c = XGetXCBConnection(s.dpy);
+    while (pending) {
+        prop_fetch *f = pending;
+        pending = f->next;
+        xcb_discard_reply(c, f->list.sequence);
+        xcb_discard_reply(c, f->wintype.sequence);
+        xcb_discard_reply(c, f->transient_for.sequence);
+        xcb_discard_reply(c, f->opacity.sequence);
+        xcb_discard_reply(c, f->desktop.sequence);
+        xcb_discard_reply(c, f->sync_counter.sequence);
+        free(f);
+    }
+}
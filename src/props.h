@@ -0,0 +1,34 @@
+#pragma once
+
+#include "window.h"
+#include <X11/Xlib.h>
+
+// window properties map_win needs
+typedef struct _win_props {
+    Window props_window_id; // None if the window has no properties
+    wintype window_type;
+    double opacity;
+    long desktop; // -1 when unknown
+    XID sync_counter; // extended counter of _NET_WM_SYNC_REQUEST_COUNTER, None if there is none
+} win_props;
+
+/*
+ * sends the property requests for a window without waiting for the replies
+ * does nothing if requests for this window are already pending
+ */
+void props_prefetch(Window id);
+
+/*
+ * prefetches the properties of all windows with a MapNotify in events
+ */
+void props_prefetch_events(XEvent *events, int n);
+
+/*
+ * collects the properties of a window, sending the requests first if they were not prefetched
+ */
+void props_get(Window id, win_props *props);
+
+/*
+ * drops all pending requests, their replies would be outdated by the next events
+ */
+void props_clear(void);
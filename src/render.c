@@ -1,41 +1,46 @@
+#include "frame.h"
+#include "overview.h"
+#include "present.h"
+#include "render.h"
 #include "session.h"
+#include "trace.h"
 #include "string.h"
 #include "util.h"
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
 #include <X11/extensions/Xcomposite.h>
 #include <X11/extensions/Xrender.h>
+#include <X11/extensions/shape.h>
+#include <math.h>
+#include <stdlib.h>
 
-/* 
- * scales window down relative to its center
- * upscaling doesn't work maybe because damage is not added
+/*
+ * sets a scale transform relative to the picture origin and a matching filter on the window picture
+ * w->transform caches what the server has so requests are only sent on change
  */
-static void centered_scale(win *w, XRectangle *geometry) {
-    if (w->scale > 1.0) // TODO for now only downscaling is supported so we force max scale to 1
-        w->scale = 1.0;
-
-    double offset_x = (geometry->width - (geometry->width * w->scale)) / 2.0; // use abs(wid - (wid * scale)) / 2.0 for upscale support
-    double offset_y = (geometry->height - (geometry->height * w->scale)) / 2.0;
-
-    // scale transformation matrix
-    XTransform xform = {{{XDoubleToFixed(1.0), XDoubleToFixed(0.0), XDoubleToFixed(0.0)},
-                         {XDoubleToFixed(0.0), XDoubleToFixed(1.0), XDoubleToFixed(0.0)},
-                         {XDoubleToFixed(0.0), XDoubleToFixed(0.0), XDoubleToFixed(w->scale)}}};
-
-    XRenderSetPictureFilter(s.dpy, w->picture, FilterBest, NULL, 0); // antialias scaled picture
-    XRenderSetPictureTransform(s.dpy, w->picture, &xform);
+void set_picture_scale(win *w, double scale) {
+    XFixed fixed_scale = XDoubleToFixed(scale);
+    // antialias scaled picture only, unless frames are over budget
+    Bool smooth = fixed_scale != XDoubleToFixed(1.0) && s.quality < QUALITY_FAST_FILTER;
+
+    if (w->transform.smooth != smooth) {
+        XRenderSetPictureFilter(s.dpy, w->picture, smooth ? FilterBest : FilterFast, NULL, 0);
+        w->transform.smooth = smooth;
+    }
 
-    geometry->width *= w->scale;
-    geometry->height *= w->scale;
-    geometry->x += offset_x;
-    geometry->y += offset_y;
+    if (w->transform.scale != fixed_scale) {
+        XTransform xform = {{{XDoubleToFixed(1.0), XDoubleToFixed(0.0), XDoubleToFixed(0.0)},
+                             {XDoubleToFixed(0.0), XDoubleToFixed(1.0), XDoubleToFixed(0.0)},
+                             {XDoubleToFixed(0.0), XDoubleToFixed(0.0), fixed_scale}}};
+        XRenderSetPictureTransform(s.dpy, w->picture, &xform);
+        w->transform.scale = fixed_scale;
+    }
 }
 
 void add_damage(XserverRegion damage) {
-    if (s.all_damage) {
-        XFixesUnionRegion(s.dpy, s.all_damage, s.all_damage, damage);
-        XFixesDestroyRegion(s.dpy, damage);
-    } else
-        s.all_damage = damage;
+    if (!s.all_damage)
+        s.all_damage = frame_region(NULL, 0);
+    XFixesUnionRegion(s.dpy, s.all_damage, s.all_damage, damage);
 }
 
 static Picture solid_picture(Bool argb, double a, double r, double g, double b) {
@@ -124,6 +129,115 @@ static void paint_root(void) {
                      0, 0, 0, 0, 0, 0, s.root_width, s.root_height);
 }
 
+#define DIM_LEVELS 32
+
+// black pictures darkening inactive windows, shared by every window with the same dim
+static Picture dim_pictures[DIM_LEVELS + 1];
+
+static Picture dim_picture(double dim) {
+    int level = dim * DIM_LEVELS + 0.5;
+    if (!level)
+        return None;
+    if (!dim_pictures[level])
+        dim_pictures[level] = solid_picture(False, (double) level / DIM_LEVELS, 0, 0, 0);
+    return dim_pictures[level];
+}
+
+/*
+ * darkens the window painted at w_geo with the clip of its paint, the window picture is the mask
+ * so that the transparent parts of argb windows are not darkened
+ * the dim is scaled by the opacity so that it does not darken what is under a translucent window
+ */
+static void paint_dim(win *w, XRectangle *w_geo) {
+    Picture dim = dim_picture(w->dim * (w->mode == WINDOW_SOLID ? 1.0 : w->opacity));
+    if (!dim)
+        return;
+
+    set_ignore(NextRequest(s.dpy));
+    XRenderComposite(s.dpy, PictOpOver, dim, w->picture, s.root_buffer,
+                     0, 0, 0, 0,
+                     w_geo->x, w_geo->y, w_geo->width, w_geo->height);
+}
+
+#define CORNER_ALPHA_LEVELS 32
+
+/*
+ * antialiased quarter circles of a radius, built once and shared by every window with that radius
+ * the opacity of translucent windows is baked in, so one mask is enough to paint a corner
+ */
+typedef struct _corner_masks {
+    struct _corner_masks *next;
+    int radius;
+    int alpha; // in CORNER_ALPHA_LEVELS
+    Picture corners[4]; // same order as win_corner_rects
+} corner_masks;
+
+static corner_masks *corner_masks_list = NULL;
+
+static corner_masks *corner_masks_get(int radius, double opacity) {
+    int alpha = opacity * CORNER_ALPHA_LEVELS + 0.5;
+    corner_masks *c;
+    for (c = corner_masks_list; c; c = c->next)
+        if (c->radius == radius && c->alpha == alpha)
+            return c;
+
+    c = malloc(sizeof(corner_masks));
+    c->radius = radius;
+    c->alpha = alpha;
+    XImage *image = XCreateImage(s.dpy, DefaultVisual(s.dpy, s.screen), 8, ZPixmap, 0, NULL, radius, radius, 8, 0);
+    image->data = malloc(image->bytes_per_line * radius);
+    GC gc = None;
+
+    // a picture only references its pixmap, each corner needs its own
+    for (int i = 0; i < 4; i++) {
+        Pixmap pixmap = XCreatePixmap(s.dpy, s.root, radius, radius, 8);
+        if (!gc)
+            gc = XCreateGC(s.dpy, pixmap, 0, NULL);
+        for (int y = 0; y < radius; y++) {
+            for (int x = 0; x < radius; x++) {
+                // distance of the pixel center to the center of the circle, mirrored for each corner
+                double dx = (i == 0 || i == 3 ? radius - x : x + 1) - 0.5;
+                double dy = (i < 2 ? radius - y : y + 1) - 0.5;
+                double coverage = radius - sqrt(dx * dx + dy * dy) + 0.5;
+                coverage = coverage < 0 ? 0 : coverage > 1 ? 1 : coverage;
+                image->data[y * image->bytes_per_line + x] = coverage * alpha * 255 / CORNER_ALPHA_LEVELS;
+            }
+        }
+        XPutImage(s.dpy, pixmap, gc, image, 0, 0, 0, 0, radius, radius);
+        c->corners[i] = XRenderCreatePicture(s.dpy, pixmap, XRenderFindStandardFormat(s.dpy, PictStandardA8), 0, NULL);
+        XFreePixmap(s.dpy, pixmap); // kept by the server until the picture is freed
+    }
+    XFreeGC(s.dpy, gc);
+    XDestroyImage(image);
+
+    c->next = corner_masks_list;
+    corner_masks_list = c;
+    return c;
+}
+
+/*
+ * paints the rounded corners of a window over what is under them, with the clip already set
+ * their cost only depends on the radius, the rest of the window is painted as usual
+ */
+static void paint_corners(win *w, XRectangle *w_geo, int radius) {
+    corner_masks *c = corner_masks_get(radius, w->mode == WINDOW_SOLID ? 1.0 : w->opacity);
+    // the masks already carry the opacity
+    Picture dim = dim_picture(w->dim);
+    XRectangle r[4];
+    win_corner_rects(w_geo, radius, r);
+
+    for (int i = 0; i < 4; i++) {
+        set_ignore(NextRequest(s.dpy));
+        XRenderComposite(s.dpy, PictOpOver, w->picture, c->corners[i], s.root_buffer,
+                         r[i].x - w_geo->x, r[i].y - w_geo->y, 0, 0,
+                         r[i].x, r[i].y, radius, radius);
+        if (dim)
+            XRenderComposite(s.dpy, PictOpOver, dim, c->corners[i], s.root_buffer,
+                             0, 0, 0, 0,
+                             r[i].x, r[i].y, radius, radius);
+    }
+}
+
 /*
  * region is None if window is not solid
  */
@@ -134,17 +248,13 @@ static void paint_window(win *w, XserverRegion region) {
         .width = w->attr.width + w->attr.border_width * 2,
         .height = w->attr.height + w->attr.border_width * 2};
 
-    if (w->action_running && !w->need_effect)
-        w->need_effect = True;
-
-    if (w->need_effect) {
-        centered_scale(w, &w_geo);
-
-        w_geo.x += w->offset_x;
-        w_geo.y += w->offset_y;
-
-        if (!w->action_running)
-            w->need_effect = False;
+    Bool effect = win_paint_effect(w);
+    if (effect) {
+        win_effect_geometry(w, &w_geo);
+        set_picture_scale(w, w->scale);
+    } else {
+        // back to identity once the effect is over
+        set_picture_scale(w, 1.0);
     }
 
     if (region) { // solid window
@@ -152,12 +262,42 @@ static void paint_window(win *w, XserverRegion region) {
         set_ignore(NextRequest(s.dpy));
         XFixesSubtractRegion(s.dpy, region, region, w->border_size);
 
-        set_ignore(NextRequest(s.dpy));
-        XRenderComposite(s.dpy, PictOpSrc, w->picture, None, s.root_buffer,
-                         0, 0, 0, 0,
-                         w_geo.x, w_geo.y, w_geo.width, w_geo.height);
+        int radius = win_corner_radius(w);
+        if (radius) {
+            // the interior stays solid, the corners are painted over the lower windows by paint_rounded
+            XRectangle r[3];
+            win_interior_rects(&w_geo, radius, r);
+            for (int i = 0; i < 3; i++) {
+                set_ignore(NextRequest(s.dpy));
+                XRenderComposite(s.dpy, PictOpSrc, w->picture, None, s.root_buffer,
+                                 r[i].x - w_geo.x, r[i].y - w_geo.y, 0, 0,
+                                 r[i].x, r[i].y, r[i].width, r[i].height);
+            }
+        } else {
+            set_ignore(NextRequest(s.dpy));
+            XRenderComposite(s.dpy, PictOpSrc, w->picture, None, s.root_buffer,
+                             0, 0, 0, 0,
+                             w_geo.x, w_geo.y, w_geo.width, w_geo.height);
+        }
+        // the window stays solid, the lower windows are still clipped out of its area
+        paint_dim(w, &w_geo);
     } else {
-        XFixesIntersectRegion(s.dpy, w->border_clip, w->border_clip, w->border_size);
+        // the corners are outside of border_size, they are painted before the clip is narrowed to it
+        int radius = win_corner_radius(w);
+        if (radius)
+            paint_corners(w, &w_geo, radius);
+        // border_size is where the window is once the effect is over, it may be scaled or moved beyond it
+        if (effect && w->scale == 1.0) {
+            // a move only offsets the window, its shape and corners are kept
+            XserverRegion moved = frame_region(NULL, 0);
+            XFixesCopyRegion(s.dpy, moved, w->border_size);
+            XFixesTranslateRegion(s.dpy, moved, w->offset_x, w->offset_y);
+            XFixesIntersectRegion(s.dpy, w->border_clip, w->border_clip, moved);
+        } else if (effect) {
+            XFixesIntersectRegion(s.dpy, w->border_clip, w->border_clip, frame_region(&w_geo, 1));
+        } else {
+            XFixesIntersectRegion(s.dpy, w->border_clip, w->border_clip, w->border_size);
+        }
         XFixesSetPictureClipRegion(s.dpy, s.root_buffer, 0, 0, w->border_clip);
 
         // creates w->alpha_picture mask to apply window opacity
@@ -168,34 +308,116 @@ static void paint_window(win *w, XserverRegion region) {
         XRenderComposite(s.dpy, PictOpOver, w->picture, w->alpha_picture, s.root_buffer,
                          0, 0, 0, 0,
                          w_geo.x, w_geo.y, w_geo.width, w_geo.height);
+        paint_dim(w, &w_geo);
     }
 }
 
-void paint_all(XserverRegion region) {
+/*
+ * puts the frame painted in root_buffer on screen
+ */
+static void xrender_show(XserverRegion region) {
+    if (s.use_present) {
+        XFixesSetPictureClipRegion(s.dpy, s.root_buffer, 0, 0, None);
+        present_frame(s.root_buffer_pixmap, region);
+    } else if (s.root_buffer != s.root_picture) {
+        XFixesSetPictureClipRegion(s.dpy, s.root_buffer, 0, 0, None);
+        XRenderComposite(s.dpy, PictOpSrc, s.root_buffer, None, s.root_picture,
+                         0, 0, 0, 0, 0, 0, s.root_width, s.root_height);
+    }
+}
+
+/*
+ * the corners of a solid window, its interior was painted with the solid windows
+ */
+static void paint_rounded(win *w) {
+    int radius = win_corner_radius(w);
+    if (!radius)
+        return;
+
+    XRectangle w_geo;
+    COPY_AREA(&w_geo, &w->attr);
+    w_geo.width += w->attr.border_width * 2;
+    w_geo.height += w->attr.border_width * 2;
+    paint_corners(w, &w_geo, radius);
+}
+
+Picture win_picture(win *w) {
+    if (w->picture)
+        return w->picture;
+
+    XRenderPictureAttributes pa;
+    XRenderPictFormat *format;
+    Drawable draw = w->id;
+
+    if (!w->pixmap)
+        w->pixmap = XCompositeNameWindowPixmap(s.dpy, w->id);
+    if (w->pixmap)
+        draw = w->pixmap;
+
+    format = XRenderFindVisualFormat(s.dpy, w->cold->visual);
+    pa.subwindow_mode = IncludeInferiors;
+    w->picture = XRenderCreatePicture(s.dpy, draw,
+                                      format,
+                                      CPSubwindowMode,
+                                      &pa);
+    // new pictures start with an identity transform and the nearest filter
+    w->transform.scale = XDoubleToFixed(1.0);
+    w->transform.smooth = False;
+    return w->picture;
+}
+
+/*
+ * the overview is painted as a whole from the thumbnails, the windows themselves are not painted
+ */
+static void paint_overview(void) {
+    static Picture shade = None;
+    if (!shade)
+        shade = solid_picture(False, 0.5, 0, 0, 0);
+
+    XFixesSetPictureClipRegion(s.dpy, s.root_buffer, 0, 0, None);
+    paint_root();
+    XRenderComposite(s.dpy, PictOpOver, shade, None, s.root_buffer,
+                     0, 0, 0, 0, 0, 0, s.root_width, s.root_height);
+    overview_paint(s.root_buffer);
+}
+
+static void xrender_paint_all(XserverRegion region) {
     win *w;
     win *t = NULL;
 
-    if (!region) {
+    // the thumbnails are laid out over the whole screen
+    if (!region || s.overview) {
         XRectangle r;
         r.x = 0;
         r.y = 0;
         r.width = s.root_width;
         r.height = s.root_height;
-        region = XFixesCreateRegion(s.dpy, &r, 1);
+        region = frame_region(&r, 1);
     }
 
     if (!s.root_buffer) {
-        Pixmap rootPixmap = XCreatePixmap(s.dpy, s.root, s.root_width, s.root_height,
-                                          DefaultDepth(s.dpy, s.screen));
-        s.root_buffer = XRenderCreatePicture(s.dpy, rootPixmap,
+        // the pixmap is kept for presenting it
+        s.root_buffer_pixmap = XCreatePixmap(s.dpy, s.root, s.root_width, s.root_height,
+                                             DefaultDepth(s.dpy, s.screen));
+        s.root_buffer = XRenderCreatePicture(s.dpy, s.root_buffer_pixmap,
                                              XRenderFindVisualFormat(s.dpy,
                                                                      DefaultVisual(s.dpy, s.screen)),
                                              0, NULL);
-        XFreePixmap(s.dpy, rootPixmap);
     }
 
     XFixesSetPictureClipRegion(s.dpy, s.root_picture, 0, 0, region);
 
+    if (s.overview) {
+        paint_overview();
+        xrender_show(region);
+        return;
+    }
+
+    // the solid windows are cut out of region as they are painted, the whole damage is presented
+    XserverRegion update = frame_region(NULL, 0);
+    XFixesCopyRegion(s.dpy, update, region);
+
+    TRACE_BEGIN("solid");
     // draw solid windows into root_buffer
     for (w = s.managed_windows; w; w = w->next) {
         /* never painted, ignore it */
@@ -204,23 +426,7 @@ void paint_all(XserverRegion region) {
         /* if invisible, ignore it */
         if (w->attr.x + w->attr.width < 1 || w->attr.y + w->attr.height < 1 || w->attr.x >= s.root_width || w->attr.y >= s.root_height)
             continue;
-        if (!w->picture) {
-            XRenderPictureAttributes pa;
-            XRenderPictFormat *format;
-            Drawable draw = w->id;
-
-            if (!w->pixmap)
-                w->pixmap = XCompositeNameWindowPixmap(s.dpy, w->id);
-            if (w->pixmap)
-                draw = w->pixmap;
-
-            format = XRenderFindVisualFormat(s.dpy, w->attr.visual);
-            pa.subwindow_mode = IncludeInferiors;
-            w->picture = XRenderCreatePicture(s.dpy, draw,
-                                              format,
-                                              CPSubwindowMode,
-                                              &pa);
-        }
+        win_picture(w);
 
         if (s.clip_changed) {
             if (w->border_size) {
@@ -232,10 +438,6 @@ void paint_all(XserverRegion region) {
                 XFixesDestroyRegion(s.dpy, w->extents);
                 w->extents = None;
             }
-            if (w->border_clip) {
-                XFixesDestroyRegion(s.dpy, w->border_clip);
-                w->border_clip = None;
-            }
         }
         if (!w->border_size)
             w->border_size = border_size(w);
@@ -245,30 +447,109 @@ void paint_all(XserverRegion region) {
             paint_window(w, region);
 
         if (!w->border_clip) {
-            w->border_clip = XFixesCreateRegion(s.dpy, NULL, 0);
+            w->border_clip = frame_region(NULL, 0);
             XFixesCopyRegion(s.dpy, w->border_clip, region);
         }
         w->prev_trans = t;
         t = w;
     }
 
+    TRACE_END("solid");
     XFixesSetPictureClipRegion(s.dpy, s.root_buffer, 0, 0, region);
     paint_root();
 
+    TRACE_BEGIN("translucent");
     // draw non solid windows into root_buffer
     for (w = t; w; w = w->prev_trans) {
         XFixesSetPictureClipRegion(s.dpy, s.root_buffer, 0, 0, w->border_clip);
 
         if (w->mode == WINDOW_TRANS || w->mode == WINDOW_ARGB)
             paint_window(w, None);
+        else
+            paint_rounded(w);
 
-        XFixesDestroyRegion(s.dpy, w->border_clip);
         w->border_clip = None;
     }
-    XFixesDestroyRegion(s.dpy, region);
-    if (s.root_buffer != s.root_picture) {
-        XFixesSetPictureClipRegion(s.dpy, s.root_buffer, 0, 0, None);
-        XRenderComposite(s.dpy, PictOpSrc, s.root_buffer, None, s.root_picture,
-                         0, 0, 0, 0, 0, 0, s.root_width, s.root_height);
+    TRACE_END("translucent");
+    xrender_show(update);
+}
+
+static Bool xrender_init(void) {
+    if (s.use_present && !present_init()) {
+        fprintf(stderr, "no Present extension, frames are copied to the root\n");
+        s.use_present = False;
     }
+    return True;
+}
+
+static void xrender_release_root(void) {
+    if (!s.root_tile)
+        return;
+    XClearArea(s.dpy, s.root, 0, 0, 0, 0, True);
+    XRenderFreePicture(s.dpy, s.root_tile);
+    s.root_tile = None;
+}
+
+const backend xrender_backend = {
+    .name = "xrender",
+    .init = xrender_init,
+    .paint_all = xrender_paint_all,
+    .release_win = NULL, // w->picture is freed with the window pixmap
+    .release_root = xrender_release_root};
+
+static const backend *backends[] = {&xrender_backend, &glx_backend, &pixman_backend};
+static const backend *current_backend = &xrender_backend;
+
+Bool render_pictures(void) {
+    return current_backend == &xrender_backend;
+}
+
+void render_init(const char *backend_name) {
+    const backend *b = NULL;
+
+    if (!backend_name)
+        backend_name = xrender_backend.name;
+    for (unsigned int i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+        if (strcmp(backends[i]->name, backend_name) == 0)
+            b = backends[i];
+
+    if (!b)
+        eprintf("unknown backend '%s'\n", backend_name);
+    if (b != &xrender_backend && s.use_present) {
+        fprintf(stderr, "presenting is only supported by the %s backend\n", xrender_backend.name);
+        s.use_present = False;
+    }
+    if (!b->init()) {
+        fprintf(stderr, "could not initialize the %s backend, using %s\n", b->name, xrender_backend.name);
+        b = &xrender_backend;
+        b->init();
+    }
+    current_backend = b;
+}
+
+Window overlay_get(void) {
+    Window overlay = XCompositeGetOverlayWindow(s.dpy, s.root);
+    XserverRegion region = XFixesCreateRegion(s.dpy, NULL, 0);
+    XFixesSetWindowShapeRegion(s.dpy, overlay, ShapeInput, 0, 0, region);
+    XFixesDestroyRegion(s.dpy, region);
+    return overlay;
+}
+
+void overlay_release(void) {
+    XCompositeReleaseOverlayWindow(s.dpy, s.root);
+}
+
+void render_release_win(win *w) {
+    if (current_backend->release_win)
+        current_backend->release_win(w);
+}
+
+void render_release_root(void) {
+    current_backend->release_root();
+}
+
+void paint_all(XserverRegion region) {
+    TRACE_BEGIN("paint_all");
+    current_backend->paint_all(region);
+    TRACE_END("paint_all");
 }
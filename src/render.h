@@ -1,7 +1,57 @@
 #pragma once
 
+#include "window.h"
 #include <X11/extensions/Xdamage.h>
 
+// a way of compositing the managed windows to the screen
+typedef struct _backend {
+    const char *name;
+    Bool (*init)(void);
+    void (*paint_all)(XserverRegion region); // region is a frame region or None for the whole screen
+    void (*release_win)(win *w); // frees what the backend keeps for w->pixmap
+    void (*release_root)(void);  // the root background changed
+} backend;
+
+extern const backend xrender_backend;
+extern const backend glx_backend;
+extern const backend pixman_backend;
+
+/*
+ * selects a backend by name, NULL for the default one
+ * falls back to xrender if the backend can't be initialized
+ */
+void render_init(const char *backend_name);
+
+/*
+ * maps the composite overlay window, input goes through it
+ */
+Window overlay_get(void);
+
+void overlay_release(void);
+
+void render_release_win(win *w);
+
+void render_release_root(void);
+
+/*
+ * adds damage to the damage of the next frame, damage is left to the caller
+ */
 void add_damage(XserverRegion damage);
 
 void paint_all(XserverRegion region);
+
+/*
+ * True if the backend paints the window pictures with XRender, thumbnails and the overview need it
+ */
+Bool render_pictures(void);
+
+/*
+ * the picture of the window pixmap, created on first use and freed along with the pixmap
+ */
+Picture win_picture(win *w);
+
+/*
+ * sets a scale transform relative to the picture origin and a matching filter on the window picture
+ * the transform is only sent to the server when it changes, painting sets it back
+ */
+void set_picture_scale(win *w, double scale);
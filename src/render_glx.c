@@ -0,0 +1,446 @@
+#define GL_GLEXT_PROTOTYPES
+#include "render.h"
+#include "session.h"
+#include "util.h"
+#include "window.h"
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <GL/glx.h>
+#include <GL/glxext.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xcomposite.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * GLX_EXT_texture_from_pixmap backend
+ * window pixmaps are bound as textures and drawn on the composite overlay window,
+ * opacity, scale and offset of effects are applied in the vertex and fragment shaders
+ */
+
+// what the backend keeps for a window pixmap, in w->backend_data
+typedef struct _glx_win {
+    GLXPixmap glx_pixmap;
+    GLuint texture;
+    Bool y_inverted;
+    Bool smooth; // GL_LINEAR when True, GL_NEAREST otherwise
+} glx_win;
+
+// per vertex: corner (2), window rect (4), scale and offset (3), opacity (1), y inverted (1), dim (1), corner radius (1)
+#define VERTEX_SIZE 13
+#define QUAD_VERTICES 6
+
+static const char *vertex_shader_source =
+    "#version 120\n"
+    "uniform vec2 screen;\n"
+    "uniform vec2 repeat;\n"
+    "attribute vec2 corner;\n"
+    "attribute vec4 rect;\n"
+    "attribute vec3 transform;\n"
+    "attribute float opacity;\n"
+    "attribute float y_inverted;\n"
+    "attribute float dim;\n"
+    "attribute float radius;\n"
+    "varying vec2 texcoord;\n"
+    "varying float alpha;\n"
+    "varying float brightness;\n"
+    "varying vec2 local;\n"
+    "varying vec2 half_size;\n"
+    "varying float corner_radius;\n"
+    "void main() {\n"
+    "    vec2 size = rect.zw * transform.x;\n"
+    "    vec2 pos = rect.xy + (rect.zw - size) / 2.0 + transform.yz + corner * size;\n"
+    "    vec2 t = corner * repeat;\n"
+    "    texcoord = vec2(t.x, y_inverted > 0.5 ? t.y : 1.0 - t.y);\n"
+    "    alpha = opacity;\n"
+    "    brightness = 1.0 - dim;\n"
+    "    half_size = rect.zw / 2.0;\n"
+    "    local = corner * rect.zw - half_size;\n"
+    "    corner_radius = radius;\n"
+    "    gl_Position = vec4(pos.x / screen.x * 2.0 - 1.0, 1.0 - pos.y / screen.y * 2.0, 0.0, 1.0);\n"
+    "}\n";
+
+// window contents are premultiplied, so is the output
+static const char *fragment_shader_source =
+    "#version 120\n"
+    "uniform sampler2D tex;\n"
+    "varying vec2 texcoord;\n"
+    "varying float alpha;\n"
+    "varying float brightness;\n"
+    "varying vec2 local;\n"
+    "varying vec2 half_size;\n"
+    "varying float corner_radius;\n"
+    "void main() {\n"
+    "    vec4 color = texture2D(tex, texcoord) * alpha;\n"
+    "    // distance past the rounded corner, 0 everywhere else\n"
+    "    vec2 d = max(abs(local) - (half_size - corner_radius), 0.0);\n"
+    "    float coverage = corner_radius > 0.0 ? clamp(corner_radius - length(d) + 0.5, 0.0, 1.0) : 1.0;\n"
+    "    gl_FragColor = vec4(color.rgb * brightness, color.a) * coverage;\n"
+    "}\n";
+
+static Window overlay;
+static GLXContext context;
+static GLuint program, vbo;
+static GLint screen_location;
+static GLint repeat_location; // times the texture is repeated across the quad, only the root tile repeats
+static GLint attrib_locations[7];
+static PFNGLXBINDTEXIMAGEEXTPROC bind_tex_image;
+static PFNGLXRELEASETEXIMAGEEXTPROC release_tex_image;
+
+// fbconfigs able to bind pixmaps of a given depth, looked up once per depth
+static GLXFBConfig fbconfigs[33];
+static Bool fbconfigs_looked_up[33];
+
+static GLfloat *vertices = NULL;
+static size_t size_vertices = 0;
+
+// windows of the quads in vertices, top to bottom
+static win **painted = NULL;
+static size_t size_painted = 0;
+
+static Pixmap root_pixmap = None;
+static glx_win *root_tile = NULL;
+static unsigned int root_tile_width, root_tile_height;
+
+static GLXFBConfig find_fbconfig(int depth) {
+    if (depth < 0 || depth > 32)
+        return NULL;
+    if (fbconfigs_looked_up[depth])
+        return fbconfigs[depth];
+    fbconfigs_looked_up[depth] = True;
+
+    int attribs[] = {
+        GLX_DRAWABLE_TYPE, GLX_PIXMAP_BIT,
+        GLX_BIND_TO_TEXTURE_TARGETS_EXT, GLX_TEXTURE_2D_BIT_EXT,
+        depth == 32 ? GLX_BIND_TO_TEXTURE_RGBA_EXT : GLX_BIND_TO_TEXTURE_RGB_EXT, True,
+        GLX_DOUBLEBUFFER, False,
+        None};
+    int n;
+    GLXFBConfig *configs = glXChooseFBConfig(s.dpy, s.screen, attribs, &n);
+    for (int i = 0; i < n && !fbconfigs[depth]; i++) {
+        XVisualInfo *vi = glXGetVisualFromFBConfig(s.dpy, configs[i]);
+        if (vi && vi->depth == depth)
+            fbconfigs[depth] = configs[i];
+        if (vi)
+            XFree(vi);
+    }
+    if (configs)
+        XFree(configs);
+    return fbconfigs[depth];
+}
+
+static glx_win *bind_pixmap(Pixmap pixmap, int depth) {
+    GLXFBConfig fbconfig = find_fbconfig(depth);
+    if (!fbconfig)
+        return NULL;
+
+    int attribs[] = {
+        GLX_TEXTURE_TARGET_EXT, GLX_TEXTURE_2D_EXT,
+        GLX_TEXTURE_FORMAT_EXT, depth == 32 ? GLX_TEXTURE_FORMAT_RGBA_EXT : GLX_TEXTURE_FORMAT_RGB_EXT,
+        None};
+    int y_inverted = 0;
+    glXGetFBConfigAttrib(s.dpy, fbconfig, GLX_Y_INVERTED_EXT, &y_inverted);
+
+    glx_win *g = malloc(sizeof(glx_win));
+    g->glx_pixmap = glXCreatePixmap(s.dpy, fbconfig, pixmap, attribs);
+    g->y_inverted = y_inverted;
+    g->smooth = False;
+
+    glGenTextures(1, &g->texture);
+    glBindTexture(GL_TEXTURE_2D, g->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    bind_tex_image(s.dpy, g->glx_pixmap, GLX_FRONT_LEFT_EXT, NULL);
+    return g;
+}
+
+// the texture only follows the pixmap contents after being bound again
+static void rebind_pixmap(glx_win *g) {
+    glBindTexture(GL_TEXTURE_2D, g->texture);
+    release_tex_image(s.dpy, g->glx_pixmap, GLX_FRONT_LEFT_EXT);
+    bind_tex_image(s.dpy, g->glx_pixmap, GLX_FRONT_LEFT_EXT, NULL);
+}
+
+static void unbind_pixmap(glx_win *g) {
+    glBindTexture(GL_TEXTURE_2D, g->texture);
+    release_tex_image(s.dpy, g->glx_pixmap, GLX_FRONT_LEFT_EXT);
+    glDeleteTextures(1, &g->texture);
+    glXDestroyPixmap(s.dpy, g->glx_pixmap);
+    free(g);
+}
+
+static void push_quad(size_t *n, double x, double y, double width, double height,
+                      double scale, double offset_x, double offset_y, double opacity, Bool y_inverted, double dim, int radius) {
+    static const GLfloat corners[QUAD_VERTICES][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 0}, {1, 1}, {0, 1}};
+
+    if ((*n + QUAD_VERTICES) * VERTEX_SIZE > size_vertices)
+        vertices = realloc(vertices, (size_vertices += 64 * QUAD_VERTICES * VERTEX_SIZE) * sizeof(GLfloat));
+
+    for (int i = 0; i < QUAD_VERTICES; i++) {
+        GLfloat *v = &vertices[(*n + i) * VERTEX_SIZE];
+        v[0] = corners[i][0];
+        v[1] = corners[i][1];
+        v[2] = x;
+        v[3] = y;
+        v[4] = width;
+        v[5] = height;
+        v[6] = scale;
+        v[7] = offset_x;
+        v[8] = offset_y;
+        v[9] = opacity;
+        v[10] = y_inverted;
+        v[11] = dim;
+        v[12] = radius;
+    }
+    *n += QUAD_VERTICES;
+}
+
+static GLuint compile_shader(GLenum type, const char *source) {
+    GLint ok;
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[512];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "glx: shader compilation failed: %s\n", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static Bool glx_init(void) {
+    int composite_major, composite_minor;
+    XCompositeQueryVersion(s.dpy, &composite_major, &composite_minor);
+    if (!(composite_major > 0 || composite_minor >= 3)) {
+        fprintf(stderr, "glx: requires composite extension version 0.3 or higher\n");
+        return False;
+    }
+
+    const char *extensions = glXQueryExtensionsString(s.dpy, s.screen);
+    if (!extensions || !strstr(extensions, "GLX_EXT_texture_from_pixmap")) {
+        fprintf(stderr, "glx: GLX_EXT_texture_from_pixmap is not supported\n");
+        return False;
+    }
+    bind_tex_image = (PFNGLXBINDTEXIMAGEEXTPROC) glXGetProcAddress((const GLubyte *) "glXBindTexImageEXT");
+    release_tex_image = (PFNGLXRELEASETEXIMAGEEXTPROC) glXGetProcAddress((const GLubyte *) "glXReleaseTexImageEXT");
+    if (!bind_tex_image || !release_tex_image)
+        return False;
+
+    // the context has to use the visual of the overlay window
+    XVisualInfo template = {.visualid = XVisualIDFromVisual(DefaultVisual(s.dpy, s.screen))};
+    int n, doublebuffer = False;
+    XVisualInfo *vi = XGetVisualInfo(s.dpy, VisualIDMask, &template, &n);
+    if (!vi)
+        return False;
+    glXGetConfig(s.dpy, vi, GLX_DOUBLEBUFFER, &doublebuffer);
+    if (doublebuffer)
+        context = glXCreateContext(s.dpy, vi, NULL, True);
+    XFree(vi);
+    if (!context) {
+        fprintf(stderr, "glx: no double buffered context for the root visual\n");
+        return False;
+    }
+
+    overlay = overlay_get();
+
+    if (!glXMakeCurrent(s.dpy, overlay, context))
+        goto fail;
+
+    GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_shader_source);
+    GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
+    if (!vertex_shader || !fragment_shader)
+        goto fail;
+    program = glCreateProgram();
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glLinkProgram(program);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+    GLint ok;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        fprintf(stderr, "glx: shader program link failed\n");
+        goto fail;
+    }
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "tex"), 0);
+    screen_location = glGetUniformLocation(program, "screen");
+    repeat_location = glGetUniformLocation(program, "repeat");
+    glUniform2f(repeat_location, 1.0, 1.0);
+    const char *attrib_names[] = {"corner", "rect", "transform", "opacity", "y_inverted", "dim", "radius"};
+    const int attrib_sizes[] = {2, 4, 3, 1, 1, 1, 1};
+    size_t offset = 0;
+
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    for (int i = 0; i < 7; i++) {
+        attrib_locations[i] = glGetAttribLocation(program, attrib_names[i]);
+        glEnableVertexAttribArray(attrib_locations[i]);
+        glVertexAttribPointer(attrib_locations[i], attrib_sizes[i], GL_FLOAT, GL_FALSE,
+                              VERTEX_SIZE * sizeof(GLfloat), (const void *) (offset * sizeof(GLfloat)));
+        offset += attrib_sizes[i];
+    }
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glClearColor(0.5, 0.5, 0.5, 1.0);
+    glActiveTexture(GL_TEXTURE0);
+
+    return True;
+
+fail:
+    // the overlay would hide what the fallback backend paints on the root
+    glXMakeCurrent(s.dpy, None, NULL);
+    glXDestroyContext(s.dpy, context);
+    overlay_release();
+    return False;
+}
+
+static void glx_release_win(win *w) {
+    if (!w->backend_data)
+        return;
+    unbind_pixmap(w->backend_data);
+    w->backend_data = NULL;
+}
+
+static void glx_release_root(void) {
+    if (root_tile)
+        unbind_pixmap(root_tile);
+    root_tile = NULL;
+    root_pixmap = None;
+}
+
+/*
+ * binds the root background pixmap, if the root has none the clear color is used
+ */
+static void bind_root_tile(void) {
+    Atom actual_type;
+    int actual_format;
+    unsigned long nitems, bytes_after;
+    unsigned char *prop;
+
+    for (int p = 0; p < 2 && !root_pixmap; p++) { // 2 is s.background_atoms length
+        if (XGetWindowProperty(s.dpy, s.root, s.background_atoms[p],
+                               0, 4, False, AnyPropertyType,
+                               &actual_type, &actual_format, &nitems, &bytes_after, &prop) == Success &&
+            actual_type == XInternAtom(s.dpy, "PIXMAP", False) && actual_format == 32 && nitems == 1) {
+            memcpy(&root_pixmap, prop, 4);
+            XFree(prop);
+        }
+    }
+    if (!root_pixmap)
+        return;
+
+    // the background is usually a tile smaller than the screen, repeated like the xrender root_tile
+    Window root;
+    int x, y;
+    unsigned int border, depth;
+    set_ignore(NextRequest(s.dpy));
+    if (!XGetGeometry(s.dpy, root_pixmap, &root, &x, &y, &root_tile_width, &root_tile_height, &border, &depth) ||
+        !root_tile_width || !root_tile_height)
+        return;
+    root_tile = bind_pixmap(root_pixmap, DefaultDepth(s.dpy, s.screen));
+    if (!root_tile)
+        return;
+    glBindTexture(GL_TEXTURE_2D, root_tile->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+/*
+ * the whole frame is drawn again on every paint so region is ignored
+ */
+static void glx_paint_all(XserverRegion region) {
+    size_t n_vertices = 0, n_painted = 0;
+    win *w;
+
+    // vertices of the windows, top to bottom
+    for (w = s.managed_windows; w; w = w->next) {
+        if (!w->damaged)
+            continue;
+        if (w->attr.x + w->attr.width < 1 || w->attr.y + w->attr.height < 1 || w->attr.x >= s.root_width || w->attr.y >= s.root_height)
+            continue;
+
+        if (!w->pixmap)
+            w->pixmap = XCompositeNameWindowPixmap(s.dpy, w->id);
+        if (!w->backend_data) {
+            w->backend_data = bind_pixmap(w->pixmap, w->cold->depth);
+            w->contents_changed = False;
+        }
+        if (!w->backend_data)
+            continue;
+        if (w->contents_changed) {
+            rebind_pixmap(w->backend_data);
+            w->contents_changed = False;
+        }
+
+        // the extents are still used to damage the area of the window
+        if (s.clip_changed && w->extents) {
+            XFixesDestroyRegion(s.dpy, w->extents);
+            w->extents = None;
+        }
+        if (!w->extents)
+            w->extents = win_extents(w);
+
+        glx_win *g = w->backend_data;
+        Bool effect = win_paint_effect(w);
+        double scale = effect ? w->scale : 1.0;
+        Bool smooth = scale != 1.0 && s.quality < QUALITY_FAST_FILTER;
+        if (g->smooth != smooth) {
+            glBindTexture(GL_TEXTURE_2D, g->texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, smooth ? GL_LINEAR : GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, smooth ? GL_LINEAR : GL_NEAREST);
+            g->smooth = smooth;
+        }
+
+        push_quad(&n_vertices, w->attr.x, w->attr.y,
+                  w->attr.width + w->attr.border_width * 2, w->attr.height + w->attr.border_width * 2,
+                  scale, effect ? w->offset_x : 0, effect ? w->offset_y : 0,
+                  w->mode == WINDOW_SOLID ? 1.0 : w->opacity, g->y_inverted, w->dim, win_corner_radius(w));
+        if (n_painted == size_painted)
+            painted = realloc(painted, (size_painted += 64) * sizeof(win *));
+        painted[n_painted++] = w;
+    }
+
+    if (!root_tile)
+        bind_root_tile();
+    if (root_tile)
+        push_quad(&n_vertices, 0, 0, s.root_width, s.root_height, 1.0, 0, 0, 1.0, root_tile->y_inverted, 0.0, 0);
+
+    glViewport(0, 0, s.root_width, s.root_height);
+    glUniform2f(screen_location, s.root_width, s.root_height);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    // every quad is uploaded at once, a draw call is needed per texture
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, n_vertices * VERTEX_SIZE * sizeof(GLfloat), vertices, GL_STREAM_DRAW);
+
+    if (root_tile) {
+        glBindTexture(GL_TEXTURE_2D, root_tile->texture);
+        glUniform2f(repeat_location, (double) s.root_width / root_tile_width, (double) s.root_height / root_tile_height);
+        glDrawArrays(GL_TRIANGLES, n_painted * QUAD_VERTICES, QUAD_VERTICES);
+        glUniform2f(repeat_location, 1.0, 1.0);
+    }
+
+    // painted bottom to top
+    for (size_t i = n_painted; i--;) {
+        glBindTexture(GL_TEXTURE_2D, ((glx_win *) painted[i]->backend_data)->texture);
+        glDrawArrays(GL_TRIANGLES, i * QUAD_VERTICES, QUAD_VERTICES);
+    }
+
+    glXSwapBuffers(s.dpy, overlay);
+}
+
+const backend glx_backend = {
+    .name = "glx",
+    .init = glx_init,
+    .paint_all = glx_paint_all,
+    .release_win = glx_release_win,
+    .release_root = glx_release_root};
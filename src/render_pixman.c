@@ -0,0 +1,439 @@
+#include "frame.h"
+#include "render.h"
+#include "session.h"
+#include "util.h"
+#include "window.h"
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/XShm.h>
+#include <pixman.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <unistd.h>
+
+/*
+ * software backend compositing in compix with pixman
+ * window pixmaps are fetched into shared memory images when damaged, the frame is split in tiles
+ * rendered in parallel by a pool of threads and the damaged tiles are presented with a single XShmPutImage
+ */
+
+#define TILE_SIZE 128
+
+// a shared memory image, in w->backend_data for windows
+typedef struct _shm_image {
+    XShmSegmentInfo shm;
+    XImage *image;
+    pixman_format_code_t format;
+} shm_image;
+
+// what the workers need to paint a window, bottom to top in ops
+typedef struct _paint_op {
+    shm_image *src; // NULL paints the default background color
+    XRectangle geometry;
+    double scale;
+    Bool smooth; // PIXMAN_FILTER_GOOD when scaled, read by the workers instead of s.quality
+    double opacity;
+    double dim; // black painted over the window, masked by its alpha
+    pixman_op_t op;
+    Bool repeat;
+} paint_op;
+
+static shm_image *frame = NULL;
+static GC frame_gc;
+static unsigned long int frame_put_request = 0; // serial of the last XShmPutImage
+static shm_image *root_tile = NULL;
+static Bool root_tile_fetched = False;
+
+static paint_op *ops = NULL;
+static size_t n_ops = 0, size_ops = 0;
+
+static int tiles_x, tiles_y;
+static int *damaged_tiles = NULL; // indexes of the tiles to render this frame
+static int n_damaged_tiles = 0;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    unsigned int frame_id; // incremented to start the workers on a frame
+    int busy;              // workers still rendering the frame
+    atomic_int next_tile;
+    int n_workers;
+} pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+static shm_image *shm_image_new(Visual *visual, int depth, int width, int height) {
+    shm_image *img = calloc(1, sizeof(shm_image));
+
+    img->image = XShmCreateImage(s.dpy, visual, depth, ZPixmap, NULL, &img->shm, width, height);
+    if (!img->image || img->image->bits_per_pixel != 32) {
+        if (img->image)
+            XDestroyImage(img->image);
+        free(img);
+        return NULL;
+    }
+    img->format = depth == 32 ? PIXMAN_a8r8g8b8 : PIXMAN_x8r8g8b8;
+
+    img->shm.shmid = shmget(IPC_PRIVATE, img->image->bytes_per_line * height, IPC_CREAT | 0600);
+    img->shm.shmaddr = img->image->data = shmat(img->shm.shmid, NULL, 0);
+    img->shm.readOnly = False;
+    XShmAttach(s.dpy, &img->shm);
+    XSync(s.dpy, False);
+    // removed once both sides are detached
+    shmctl(img->shm.shmid, IPC_RMID, NULL);
+    return img;
+}
+
+static void shm_image_free(shm_image *img) {
+    XShmDetach(s.dpy, &img->shm);
+    img->image->data = NULL;
+    XDestroyImage(img->image);
+    shmdt(img->shm.shmaddr);
+    free(img);
+}
+
+static pixman_image_t *shm_image_pixman(shm_image *img) {
+    return pixman_image_create_bits(img->format, img->image->width, img->image->height,
+                                    (uint32_t *) img->image->data, img->image->bytes_per_line);
+}
+
+/*
+ * pixman images are created per tile so no pixman state is shared between workers
+ */
+static void render_tile(int tile) {
+    int tx = (tile % tiles_x) * TILE_SIZE;
+    int ty = (tile / tiles_x) * TILE_SIZE;
+    int tw = tx + TILE_SIZE > s.root_width ? s.root_width - tx : TILE_SIZE;
+    int th = ty + TILE_SIZE > s.root_height ? s.root_height - ty : TILE_SIZE;
+    pixman_image_t *dst = shm_image_pixman(frame);
+
+    for (size_t i = 0; i < n_ops; i++) {
+        paint_op *o = &ops[i];
+        int x1 = o->geometry.x > tx ? o->geometry.x : tx;
+        int y1 = o->geometry.y > ty ? o->geometry.y : ty;
+        int x2 = o->geometry.x + o->geometry.width < tx + tw ? o->geometry.x + o->geometry.width : tx + tw;
+        int y2 = o->geometry.y + o->geometry.height < ty + th ? o->geometry.y + o->geometry.height : ty + th;
+        if (x1 >= x2 || y1 >= y2)
+            continue;
+
+        pixman_image_t *src, *mask = NULL;
+        if (o->src) {
+            src = shm_image_pixman(o->src);
+        } else {
+            pixman_color_t gray = {0x8080, 0x8080, 0x8080, 0xffff};
+            src = pixman_image_create_solid_fill(&gray);
+        }
+        if (o->repeat)
+            pixman_image_set_repeat(src, PIXMAN_REPEAT_NORMAL);
+        if (o->scale != 1.0) {
+            pixman_transform_t xform;
+            pixman_transform_init_scale(&xform, pixman_double_to_fixed(1.0 / o->scale), pixman_double_to_fixed(1.0 / o->scale));
+            pixman_image_set_transform(src, &xform);
+            pixman_image_set_filter(src, o->smooth ? PIXMAN_FILTER_GOOD : PIXMAN_FILTER_FAST, NULL, 0);
+        }
+        if (o->opacity < 1.0) {
+            pixman_color_t alpha = {0, 0, 0, o->opacity * 0xffff};
+            mask = pixman_image_create_solid_fill(&alpha);
+        }
+
+        pixman_image_composite32(o->op, src, mask, dst,
+                                 x1 - o->geometry.x, y1 - o->geometry.y, 0, 0,
+                                 x1, y1, x2 - x1, y2 - y1);
+        if (o->dim > 0) {
+            // scaled by the opacity like the window it darkens
+            pixman_color_t black = {0, 0, 0, o->dim * o->opacity * 0xffff};
+            pixman_image_t *dim = pixman_image_create_solid_fill(&black);
+            pixman_image_composite32(PIXMAN_OP_OVER, dim, src, dst,
+                                     0, 0, x1 - o->geometry.x, y1 - o->geometry.y,
+                                     x1, y1, x2 - x1, y2 - y1);
+            pixman_image_unref(dim);
+        }
+
+        pixman_image_unref(src);
+        if (mask)
+            pixman_image_unref(mask);
+    }
+    pixman_image_unref(dst);
+}
+
+static void render_tiles(void) {
+    int tile;
+    while ((tile = atomic_fetch_add(&pool.next_tile, 1)) < n_damaged_tiles)
+        render_tile(damaged_tiles[tile]);
+}
+
+static void *worker(void *arg) {
+    unsigned int frame_id = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool.lock);
+        while (pool.frame_id == frame_id)
+            pthread_cond_wait(&pool.work, &pool.lock);
+        frame_id = pool.frame_id;
+        pthread_mutex_unlock(&pool.lock);
+
+        render_tiles();
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.busy == 0)
+            pthread_cond_signal(&pool.done);
+        pthread_mutex_unlock(&pool.lock);
+    }
+    return NULL;
+}
+
+/*
+ * renders the damaged tiles with the workers, the calling thread takes tiles too
+ */
+static void render_frame(void) {
+    pthread_mutex_lock(&pool.lock);
+    atomic_store(&pool.next_tile, 0);
+    pool.busy = pool.n_workers;
+    pool.frame_id++;
+    pthread_cond_broadcast(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+
+    render_tiles();
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.busy)
+        pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+static void push_op(shm_image *src, XRectangle *geometry, double scale, double opacity, pixman_op_t op, Bool repeat) {
+    if (n_ops == size_ops)
+        ops = realloc(ops, (size_ops += 64) * sizeof(paint_op));
+    ops[n_ops].src = src;
+    ops[n_ops].geometry = *geometry;
+    ops[n_ops].scale = scale;
+    ops[n_ops].smooth = s.quality < QUALITY_FAST_FILTER;
+    ops[n_ops].opacity = opacity;
+    ops[n_ops].dim = 0.0;
+    ops[n_ops].op = op;
+    ops[n_ops].repeat = repeat;
+    n_ops++;
+}
+
+static Bool frame_resize(void) {
+    if (frame && frame->image->width == s.root_width && frame->image->height == s.root_height)
+        return False;
+    if (frame)
+        shm_image_free(frame);
+    frame = shm_image_new(DefaultVisual(s.dpy, s.screen), DefaultDepth(s.dpy, s.screen), s.root_width, s.root_height);
+    if (!frame)
+        eprintf("pixman: the root visual must use 32 bits per pixel\n");
+
+    tiles_x = (s.root_width + TILE_SIZE - 1) / TILE_SIZE;
+    tiles_y = (s.root_height + TILE_SIZE - 1) / TILE_SIZE;
+    damaged_tiles = realloc(damaged_tiles, tiles_x * tiles_y * sizeof(int));
+    return True;
+}
+
+/*
+ * collects the tiles intersecting the damaged region and the bounding box to present
+ */
+static void damage_tiles(XserverRegion region, XRectangle *bounds) {
+    Bool *damaged = frame_alloc(tiles_x * tiles_y * sizeof(Bool));
+    int nrects = 0;
+    XRectangle *rects = region ? XFixesFetchRegion(s.dpy, region, &nrects) : NULL;
+    int x1 = s.root_width, y1 = s.root_height, x2 = 0, y2 = 0;
+
+    for (int i = 0; i < tiles_x * tiles_y; i++)
+        damaged[i] = !region;
+    if (!region) {
+        x1 = y1 = 0;
+        x2 = s.root_width;
+        y2 = s.root_height;
+    }
+    for (int r = 0; r < nrects; r++) {
+        // off screen to the left or above, the divisions below would round them to the first tiles
+        if (rects[r].x + rects[r].width <= 0 || rects[r].y + rects[r].height <= 0)
+            continue;
+        int rx1 = rects[r].x < 0 ? 0 : rects[r].x / TILE_SIZE;
+        int ry1 = rects[r].y < 0 ? 0 : rects[r].y / TILE_SIZE;
+        int rx2 = (rects[r].x + rects[r].width - 1) / TILE_SIZE;
+        int ry2 = (rects[r].y + rects[r].height - 1) / TILE_SIZE;
+        for (int ty = ry1; ty <= ry2 && ty < tiles_y; ty++)
+            for (int tx = rx1; tx <= rx2 && tx < tiles_x; tx++)
+                damaged[ty * tiles_x + tx] = True;
+    }
+    if (rects)
+        XFree(rects);
+
+    n_damaged_tiles = 0;
+    for (int i = 0; i < tiles_x * tiles_y; i++) {
+        if (!damaged[i])
+            continue;
+        damaged_tiles[n_damaged_tiles++] = i;
+        int tx = (i % tiles_x) * TILE_SIZE, ty = (i / tiles_x) * TILE_SIZE;
+        x1 = tx < x1 ? tx : x1;
+        y1 = ty < y1 ? ty : y1;
+        x2 = tx + TILE_SIZE > x2 ? tx + TILE_SIZE : x2;
+        y2 = ty + TILE_SIZE > y2 ? ty + TILE_SIZE : y2;
+    }
+
+    bounds->x = x1;
+    bounds->y = y1;
+    bounds->width = (x2 > s.root_width ? s.root_width : x2) - x1;
+    bounds->height = (y2 > s.root_height ? s.root_height : y2) - y1;
+}
+
+static void fetch_root_tile(void) {
+    Atom actual_type;
+    int actual_format;
+    unsigned long nitems, bytes_after;
+    unsigned char *prop;
+    Pixmap pixmap = None;
+
+    root_tile_fetched = True;
+    for (int p = 0; p < 2 && !pixmap; p++) { // 2 is s.background_atoms length
+        if (XGetWindowProperty(s.dpy, s.root, s.background_atoms[p],
+                               0, 4, False, AnyPropertyType,
+                               &actual_type, &actual_format, &nitems, &bytes_after, &prop) == Success &&
+            actual_type == XInternAtom(s.dpy, "PIXMAP", False) && actual_format == 32 && nitems == 1) {
+            memcpy(&pixmap, prop, 4);
+            XFree(prop);
+        }
+    }
+    if (!pixmap)
+        return;
+
+    Window root;
+    int x, y;
+    unsigned int width, height, border_width, depth;
+    if (!XGetGeometry(s.dpy, pixmap, &root, &x, &y, &width, &height, &border_width, &depth))
+        return;
+    root_tile = shm_image_new(DefaultVisual(s.dpy, s.screen), depth, width, height);
+    if (root_tile)
+        XShmGetImage(s.dpy, pixmap, root_tile->image, 0, 0, AllPlanes);
+}
+
+static void pixman_paint_all(XserverRegion region) {
+    win *w;
+    XRectangle bounds;
+
+    if (frame_resize())
+        region = None;
+    damage_tiles(region, &bounds);
+    if (!n_damaged_tiles)
+        return;
+
+    if (!root_tile_fetched)
+        fetch_root_tile();
+    XRectangle screen = {0, 0, s.root_width, s.root_height};
+    n_ops = 0;
+    push_op(root_tile, &screen, 1.0, 1.0, PIXMAN_OP_SRC, True);
+
+    // ops are painted bottom to top, the windows are walked top to bottom
+    size_t first_window_op = n_ops;
+    for (w = s.managed_windows; w; w = w->next) {
+        if (!w->damaged)
+            continue;
+        if (w->attr.x + w->attr.width < 1 || w->attr.y + w->attr.height < 1 || w->attr.x >= s.root_width || w->attr.y >= s.root_height)
+            continue;
+
+        XRectangle geometry = {
+            .x = w->attr.x,
+            .y = w->attr.y,
+            .width = w->attr.width + w->attr.border_width * 2,
+            .height = w->attr.height + w->attr.border_width * 2};
+
+        if (!w->pixmap)
+            w->pixmap = XCompositeNameWindowPixmap(s.dpy, w->id);
+        if (!w->backend_data) {
+            w->backend_data = shm_image_new(w->cold->visual, w->cold->depth, geometry.width, geometry.height);
+            w->contents_changed = True;
+        }
+        if (!w->backend_data)
+            continue;
+        if (w->contents_changed) {
+            set_ignore(NextRequest(s.dpy));
+            XShmGetImage(s.dpy, w->pixmap, ((shm_image *) w->backend_data)->image, 0, 0, AllPlanes);
+            w->contents_changed = False;
+        }
+
+        // the extents are still used to damage the area of the window
+        if (s.clip_changed && w->extents) {
+            XFixesDestroyRegion(s.dpy, w->extents);
+            w->extents = None;
+        }
+        if (!w->extents)
+            w->extents = win_extents(w);
+
+        double scale = 1.0;
+        if (win_paint_effect(w)) {
+            win_effect_geometry(w, &geometry);
+            scale = w->scale;
+        }
+        // same operators as the xrender backend
+        if (w->mode == WINDOW_SOLID)
+            push_op(w->backend_data, &geometry, scale, 1.0, PIXMAN_OP_SRC, False);
+        else
+            push_op(w->backend_data, &geometry, scale, w->opacity, PIXMAN_OP_OVER, False);
+        ops[n_ops - 1].dim = w->dim;
+    }
+    for (size_t i = first_window_op, j = n_ops - 1; i < j; i++, j--) {
+        paint_op tmp = ops[i];
+        ops[i] = ops[j];
+        ops[j] = tmp;
+    }
+
+    // the server may still be reading the previous frame from shared memory
+    if (LastKnownRequestProcessed(s.dpy) < frame_put_request)
+        XSync(s.dpy, False);
+    render_frame();
+
+    frame_put_request = NextRequest(s.dpy);
+    XShmPutImage(s.dpy, s.root, frame_gc, frame->image,
+                 bounds.x, bounds.y, bounds.x, bounds.y, bounds.width, bounds.height, False);
+}
+
+static Bool pixman_init(void) {
+    if (!XShmQueryExtension(s.dpy)) {
+        fprintf(stderr, "pixman: no MIT-SHM extension\n");
+        return False;
+    }
+
+    XGCValues gcv = {.subwindow_mode = IncludeInferiors};
+    frame_gc = XCreateGC(s.dpy, s.root, GCSubwindowMode, &gcv);
+
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    pool.n_workers = n_cpus > 1 ? n_cpus - 1 : 0;
+    for (int i = 0; i < pool.n_workers; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker, NULL) != 0) {
+            pool.n_workers = i;
+            break;
+        }
+        pthread_detach(thread);
+    }
+    return True;
+}
+
+static void pixman_release_win(win *w) {
+    if (!w->backend_data)
+        return;
+    shm_image_free(w->backend_data);
+    w->backend_data = NULL;
+}
+
+static void pixman_release_root(void) {
+    if (root_tile)
+        shm_image_free(root_tile);
+    root_tile = NULL;
+    root_tile_fetched = False;
+    XClearArea(s.dpy, s.root, 0, 0, 0, 0, True);
+}
+
+const backend pixman_backend = {
+    .name = "pixman",
+    .init = pixman_init,
+    .paint_all = pixman_paint_all,
+    .release_win = pixman_release_win,
+    .release_root = pixman_release_root};
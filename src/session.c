@@ -1,23 +1,56 @@
 #include "session.h"
 #include "action.h"
+#include "capture.h"
+#include "coalesce.h"
 #include "config.h"
 #include "effect.h"
+#include "frame.h"
+#include "framesync.h"
+#include "governor.h"
+#include "handoff.h"
+#include "ingest.h"
+#include "output.h"
+#include "overview.h"
+#include "present.h"
+#include "props.h"
 #include "render.h"
+#include "trace.h"
 #include "util.h"
 #include "window.h"
 #include <X11/Xatom.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/Xlib.h>
 #include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/Xrandr.h>
 #include <X11/extensions/Xrender.h>
 #include <X11/extensions/shape.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
 
 struct session s;
 
-static XRectangle *expose_rects = NULL;
-static int size_expose = 0;
-static int n_expose = 0;
+static volatile sig_atomic_t reload_requested = 0;
+static Window manager_window; // owns the manager selection
+
+/*
+ * another compix started with -r took the manager selection, it gets the window table
+ * it waits for manager_window to be destroyed before reading the table
+ * the automatic redirection goes away with this connection, so the windows stay redirected
+ * only if it is kept open until the next instance redirected them itself
+ */
+static void hand_off(void) {
+    Bool saved = handoff_save();
+    XCompositeRedirectSubwindows(s.dpy, s.root, CompositeRedirectAutomatic);
+    XCompositeUnredirectSubwindows(s.dpy, s.root, CompositeRedirectManual);
+    XDestroyWindow(s.dpy, manager_window);
+    XSync(s.dpy, False);
+    if (saved)
+        handoff_wait_taken();
+    exit(EXIT_SUCCESS);
+}
 
 static void handle_event(XEvent ev) {
     if ((ev.type & 0x7f) != KeymapNotify)
@@ -28,6 +61,10 @@ static void handle_event(XEvent ev) {
 #endif
 
     switch (ev.type) {
+    case GenericEvent:
+        if (!present_event(&ev.xcookie))
+            XFreeEventData(s.dpy, &ev.xcookie);
+        break;
     case CreateNotify:
         add_win(ev.xcreatewindow.window);
         break;
@@ -52,17 +89,20 @@ static void handle_event(XEvent ev) {
     case CirculateNotify:
         circulate_win(&ev.xcirculate);
         break;
+    case ClientMessage:
+        if (ev.xclient.message_type == s.overview_atom)
+            overview_message(&ev.xclient);
+        break;
+    case SelectionClear:
+        if (ev.xselectionclear.selection == s.cm_atom)
+            hand_off();
+        break;
     case Expose:
+        // a sequence of exposes can be split between two frames, each rectangle is damaged on its own
         if (ev.xexpose.window == s.root) {
-            int more = ev.xexpose.count + 1;
-            if (n_expose == size_expose)
-                expose_rects = realloc(expose_rects, (size_expose += more) * sizeof(XRectangle));
-            COPY_AREA(&expose_rects[n_expose], &ev.xexpose);
-            n_expose++;
-            if (ev.xexpose.count == 0) {
-                add_damage(XFixesCreateRegion(s.dpy, expose_rects, n_expose));
-                n_expose = 0;
-            }
+            XRectangle r;
+            COPY_AREA(&r, &ev.xexpose);
+            add_damage(frame_region(&r, 1));
         }
         break;
     case PropertyNotify:
@@ -74,15 +114,23 @@ static void handle_event(XEvent ev) {
                 w->opacity = get_opacity_prop(w, 1.0);
                 determine_mode(w);
             }
+        } else if (ev.xproperty.atom == s.active_window_atom && ev.xproperty.window == s.root) {
+            update_active_window();
+        } else if (ev.xproperty.atom == s.wm_desktop_atom) {
+            win *w = find_win(ev.xproperty.window, True);
+            if (w)
+                w->cold->desktop = get_desktop_prop(w);
+        } else if (ev.xproperty.atom == s.sync_counter_atom) {
+            win *w = find_win(ev.xproperty.window, True);
+            if (w)
+                framesync_update(w);
         } else if (ev.xproperty.atom == s.winstate_atoms[NUM_WINSTATES]) {
             win *w = find_win(ev.xproperty.window, True);
             if (w)
                 determine_winstate(w);
-        } else if (s.root_tile && (ev.xproperty.atom == s.background_atoms[0] ||
-                                   ev.xproperty.atom == s.background_atoms[1])) {
-            XClearArea(s.dpy, s.root, 0, 0, 0, 0, True);
-            XRenderFreePicture(s.dpy, s.root_tile);
-            s.root_tile = None;
+        } else if (ev.xproperty.atom == s.background_atoms[0] ||
+                   ev.xproperty.atom == s.background_atoms[1]) {
+            render_release_root();
         }
         break;
     default:
@@ -90,36 +138,153 @@ static void handle_event(XEvent ev) {
             damage_win((XDamageNotifyEvent *) &ev);
         } else if (ev.type == s.xshape_event + ShapeNotify) {
             shape_win((XShapeEvent *) &ev);
+        } else if (ev.type == s.xrandr_event + RRScreenChangeNotify) {
+            XRRUpdateConfiguration(&ev);
+            output_update();
+        } else if (s.sync_event && ev.type == s.sync_event + XSyncAlarmNotify) {
+            framesync_alarm((XSyncAlarmNotifyEvent *) &ev);
         }
         break;
     }
 }
 
+static void request_reload(int sig) {
+    reload_requested = 1;
+}
+
+/*
+ * applies config changes between two frames so that a frame never mixes two configs
+ */
+static void reload_config(void) {
+    Bool reload = reload_requested;
+    reload_requested = 0;
+
+    if (s.ufd[FD_CONFIG].revents & POLLIN) {
+        s.ufd[FD_CONFIG].revents = 0;
+        if (config_changed(s.ufd[FD_CONFIG].fd))
+            reload = True;
+    }
+
+    if (reload)
+        config_reload();
+}
+
+/*
+ * the window manager may unmap and map the windows of a desktop change before it sets
+ * _NET_CURRENT_DESKTOP, the change has to be known before the events are handled
+ */
+static void scan_desktop_change(XEvent *events, int n) {
+    for (int i = 0; i < n; i++) {
+        if (events[i].type == PropertyNotify && events[i].xproperty.window == s.root &&
+            events[i].xproperty.atom == s.current_desktop_atom) {
+            update_current_desktop();
+            return;
+        }
+    }
+}
+
+// poll timeouts, -1 waits forever
+static int min_timeout(int a, int b) {
+    if (a < 0)
+        return b;
+    if (b < 0)
+        return a;
+    return a < b ? a : b;
+}
+
 void session_loop(void) {
+    XEvent *events;
+
     for (;;) {
-        do {
-            // if no event in queue we run animations
-            if (!QLength(s.dpy)) {
-                if (poll(&s.ufd, 1, action_timeout()) == 0) {
-                    action_run();
-                    break;
-                }
-            }
+        int n = ingest_take(&events);
+        // if no event is waiting we run animations
+        if (!n) {
+            // while a frame is presented, the next one waits for its completion event
+            TRACE_BEGIN("poll");
+            int ready = poll(s.ufd, NUM_FDS, present_busy() ? action_timeout() : min_timeout(action_timeout(), output_timeout()));
+            TRACE_END("poll");
+            if (ready == 0)
+                action_run();
+            // otherwise a signal or the config watch woke us up, they are handled between frames
+            else if (ready > 0 && s.ufd[FD_EVENTS].revents & POLLIN)
+                n = ingest_take(&events);
+        }
 
-            XEvent ev;
-            XNextEvent(s.dpy, &ev);
-            handle_event(ev);
-        } while (QLength(s.dpy));
+        TRACE_BEGIN("events");
+        // request the properties of windows about to be mapped so the replies come back together
+        props_prefetch_events(events, n);
+        scan_desktop_change(events, n);
+        n = coalesce_events(events, n);
+        for (int i = 0; i < n; i++)
+            handle_event(events[i]);
+        props_clear();
+        TRACE_END("events");
+        reload_config();
+        if (s.ufd[FD_CAPTURE].revents & POLLIN) {
+            s.ufd[FD_CAPTURE].revents = 0;
+            capture_accept();
+        }
+        if (s.visibility_changed) {
+            TRACE_BEGIN("visibility");
+            win_update_visibility();
+            TRACE_END("visibility");
+        }
         if (s.all_damage) {
-            paint_all(s.all_damage);
-            XSync(s.dpy, False);
+            output_add_damage(s.all_damage);
             s.all_damage = None;
+        }
+        // outputs are painted at their own rate, the others keep their damage for later
+        XserverRegion damage = present_busy() ? None : output_take_damage();
+        if (damage) {
+            uint64_t paint_start = get_ust();
+            // paint_all cuts the solid windows out of damage, the others need all of it
+            XserverRegion painted = frame_region(NULL, 0);
+            XFixesCopyRegion(s.dpy, painted, damage);
+            paint_all(damage);
+            capture_update(painted);
+            // when no output keeps damage for later, the windows outside of it have nothing left to paint
+            framesync_drawn(output_timeout() < 0 ? None : painted);
+            // presented frames report their completion, no need to wait for the server
+            if (!s.use_present) {
+                TRACE_BEGIN("sync");
+                XSync(s.dpy, False);
+                TRACE_END("sync");
+                framesync_shown(0, 0);
+                // the server painted the frame by the end of the sync, presented frames are timed by present.c
+                governor_frame(get_ust() - paint_start);
+            }
             s.clip_changed = False;
+        } else if (framesync_pending() && output_timeout() < 0 && !present_busy()) {
+            // the finished frames did not change the screen (hidden windows), nothing is waited for
+            framesync_drawn(None);
+            framesync_shown(0, 0);
         }
+        frame_reset();
+        TRACE_FLUSH();
     }
 }
 
-static void register_composite_manager(void) {
+/*
+ * waits for the window of the previous manager to be destroyed after it lost the selection
+ * a compix destroys it once the window table is written, other managers when they exit
+ */
+static void wait_manager_exit(Window previous) {
+    XEvent ev;
+    int deadline = get_time_in_milliseconds() + 5000;
+    struct pollfd fd = {.fd = XConnectionNumber(s.dpy), .events = POLLIN};
+
+    while (!XCheckTypedWindowEvent(s.dpy, previous, DestroyNotify, &ev)) {
+        int timeout = deadline - get_time_in_milliseconds();
+        if (timeout <= 0) {
+            fprintf(stderr, "the previous composite manager did not exit, taking over anyway\n");
+            return;
+        }
+        poll(&fd, 1, timeout);
+        XEventsQueued(s.dpy, QueuedAfterReading);
+    }
+}
+
+static void register_composite_manager(Bool replace) {
     static char net_wm_cm[sizeof("_NET_WM_CM_S") + 3 * sizeof(s.screen)];
     Window w;
     Atom a, winNameAtom;
@@ -129,8 +294,22 @@ static void register_composite_manager(void) {
 
     sprintf(net_wm_cm, "_NET_WM_CM_S%i", s.screen);
     a = XInternAtom(s.dpy, net_wm_cm, False);
+    s.cm_atom = a;
     w = XGetSelectionOwner(s.dpy, a);
 
+    if (w && replace) {
+        set_ignore(NextRequest(s.dpy));
+        XSelectInput(s.dpy, w, StructureNotifyMask);
+        Window previous = w;
+        w = XCreateSimpleWindow(s.dpy, s.root, 0, 0, 1, 1, 0, None, None);
+        Xutf8SetWMProperties(s.dpy, w, "axcomp", "axcomp", NULL, 0, NULL, NULL, NULL);
+        XSetSelectionOwner(s.dpy, a, w, 0);
+        manager_window = w;
+        wait_manager_exit(previous);
+        handoff_load();
+        return;
+    }
+
     if (w) {
         winNameAtom = XInternAtom(s.dpy, "_NET_WM_NAME", False);
         if (!XGetTextProperty(s.dpy, w, &tp, winNameAtom) && !XGetTextProperty(s.dpy, w, &tp, XA_WM_NAME))
@@ -146,23 +325,122 @@ static void register_composite_manager(void) {
     w = XCreateSimpleWindow(s.dpy, s.root, 0, 0, 1, 1, 0, None, None);
     Xutf8SetWMProperties(s.dpy, w, "axcomp", "axcomp", NULL, 0, NULL, NULL, NULL);
     XSetSelectionOwner(s.dpy, a, w, 0);
+    manager_window = w;
+}
+
+static Visual *find_visual(VisualID id) {
+    Screen *screen = ScreenOfDisplay(s.dpy, s.screen);
+    for (int i = 0; i < screen->ndepths; i++)
+        for (int j = 0; j < screen->depths[i].nvisuals; j++)
+            if (screen->depths[i].visuals[j].visualid == id)
+                return &screen->depths[i].visuals[j];
+    return NULL;
 }
 
-void session_init(const char *display, const char *config_path) {
+/*
+ * builds what XGetWindowAttributes would return from the replies of the two requests it is made of
+ */
+static void attr_from_replies(XWindowAttributes *attr,
+                              const xcb_get_window_attributes_reply_t *a, const xcb_get_geometry_reply_t *g) {
+    attr->x = g->x;
+    attr->y = g->y;
+    attr->width = g->width;
+    attr->height = g->height;
+    attr->border_width = g->border_width;
+    attr->depth = g->depth;
+    attr->root = g->root;
+    attr->screen = ScreenOfDisplay(s.dpy, s.screen);
+
+    attr->visual = find_visual(a->visual);
+    attr->class = a->_class;
+    attr->bit_gravity = a->bit_gravity;
+    attr->win_gravity = a->win_gravity;
+    attr->backing_store = a->backing_store;
+    attr->backing_planes = a->backing_planes;
+    attr->backing_pixel = a->backing_pixel;
+    attr->save_under = a->save_under;
+    attr->colormap = a->colormap;
+    attr->map_installed = a->map_is_installed;
+    attr->map_state = a->map_state;
+    attr->all_event_masks = a->all_event_masks;
+    attr->your_event_mask = a->your_event_mask;
+    attr->do_not_propagate_mask = a->do_not_propagate_mask;
+    attr->override_redirect = a->override_redirect;
+}
+
+/*
+ * manages the windows that already exist at startup
+ * while the server is grabbed every request is sent before any reply is waited for,
+ * mapping (effects) and painting are done once the grab is released
+ */
+static void add_existing_windows(void) {
+    xcb_connection_t *c = XGetXCBConnection(s.dpy);
     Window root_return, parent_return;
     Window *children;
     unsigned int nchildren;
+
+    XGrabServer(s.dpy);
+    XCompositeRedirectSubwindows(s.dpy, s.root, CompositeRedirectManual);
+    XSelectInput(s.dpy, s.root,
+                 SubstructureNotifyMask |
+                     ExposureMask |
+                     StructureNotifyMask |
+                     PropertyChangeMask);
+    XShapeSelectInput(s.dpy, s.root, ShapeNotifyMask);
+    XQueryTree(s.dpy, s.root, &root_return, &parent_return, &children, &nchildren);
+
+    xcb_get_window_attributes_cookie_t *attr_cookies = malloc(nchildren * sizeof(*attr_cookies));
+    xcb_get_geometry_cookie_t *geometry_cookies = malloc(nchildren * sizeof(*geometry_cookies));
+    for (int i = 0; i < nchildren; i++) {
+        attr_cookies[i] = xcb_get_window_attributes(c, children[i]);
+        geometry_cookies[i] = xcb_get_geometry(c, children[i]);
+        // the previous instance already knows the properties of the windows it painted
+        if (!handoff_known(children[i]))
+            props_prefetch(children[i]);
+    }
+
+    for (int i = 0; i < nchildren; i++) {
+        xcb_get_window_attributes_reply_t *a = xcb_get_window_attributes_reply(c, attr_cookies[i], NULL);
+        xcb_get_geometry_reply_t *g = xcb_get_geometry_reply(c, geometry_cookies[i], NULL);
+        if (a && g) {
+            XWindowAttributes attr;
+            attr_from_replies(&attr, a, g);
+            manage_win(children[i], &attr);
+        }
+        free(a);
+        free(g);
+    }
+    free(attr_cookies);
+    free(geometry_cookies);
+    XUngrabServer(s.dpy);
+
+    // the window table is complete, the property replies are already on their way
+    for (int i = 0; i < nchildren; i++) {
+        win *w = find_win(children[i], False);
+        if (!w || w->attr.map_state != IsViewable)
+            continue;
+        if (handoff_known(w->id))
+            handoff_adopt(w);
+        else
+            map_win(w->id);
+    }
+    props_clear(); // unmapped windows never collect theirs
+    handoff_clear();
+    XFree(children);
+}
+
+void session_init(const char *display, const char *config_path, const char *backend_name, Bool use_present, Bool replace) {
     XRenderPictureAttributes pa;
     int composite_major, composite_minor;
 
+    // events are read by their own thread while this one paints
+    XInitThreads();
     s.dpy = XOpenDisplay(display);
     if (!s.dpy)
         eprintf("cannot open display\n");
     XSetErrorHandler(handle_error);
     s.screen = DefaultScreen(s.dpy);
     s.root = RootWindow(s.dpy, s.screen);
-    s.ufd.fd = XConnectionNumber(s.dpy);
-    s.ufd.events = POLLIN;
 
     if (!XRenderQueryExtension(s.dpy, &s.render_event, &s.render_error))
         eprintf("No render extension\n");
@@ -179,11 +457,18 @@ void session_init(const char *display, const char *config_path) {
         eprintf("No XFixes extension\n");
     if (!XShapeQueryExtension(s.dpy, &s.xshape_event, &s.xshape_error))
         eprintf("No XShape extension\n");
+    if (!framesync_init())
+        fprintf(stderr, "No sync extension, clients will not be told when their frames are drawn\n");
 
-    register_composite_manager();
+    register_composite_manager(replace);
 
     // get atoms
     s.opacity_atom = XInternAtom(s.dpy, "_NET_WM_WINDOW_OPACITY", False);
+    s.current_desktop_atom = XInternAtom(s.dpy, "_NET_CURRENT_DESKTOP", False);
+    s.active_window_atom = XInternAtom(s.dpy, "_NET_ACTIVE_WINDOW", False);
+    s.overview_atom = XInternAtom(s.dpy, "_COMPIX_OVERVIEW", False);
+    s.wm_desktop_atom = XInternAtom(s.dpy, "_NET_WM_DESKTOP", False);
+    s.sync_counter_atom = XInternAtom(s.dpy, "_NET_WM_SYNC_REQUEST_COUNTER", False);
     s.background_atoms[0] = XInternAtom(s.dpy, "_XROOTPMAP_ID", False);
     s.background_atoms[1] = XInternAtom(s.dpy, "_XSETROOT_ID", False);
     s.winstate_atoms[WINSTATE_MAXIMIZED_VERT] = XInternAtom(s.dpy, "_NET_WM_STATE_MAXIMIZED_VERT", False);
@@ -207,6 +492,15 @@ void session_init(const char *display, const char *config_path) {
     s.wintype_atoms[NUM_WINTYPES] = XInternAtom(s.dpy, "_NET_WM_WINDOW_TYPE", False);
 
     config_get(config_path);
+    s.ufd[FD_CONFIG].fd = config_watch();
+    s.ufd[FD_CONFIG].events = POLLIN;
+    s.ufd[FD_CAPTURE].fd = capture_listen();
+    s.ufd[FD_CAPTURE].events = POLLIN;
+
+    // no SA_RESTART, the signal has to interrupt poll in session_loop
+    struct sigaction sa = {.sa_handler = request_reload};
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, NULL);
 
     pa.subwindow_mode = IncludeInferiors;
     s.root_width = DisplayWidth(s.dpy, s.screen);
@@ -217,21 +511,20 @@ void session_init(const char *display, const char *config_path) {
                                                                   DefaultVisual(s.dpy, s.screen)),
                                           CPSubwindowMode,
                                           &pa);
+    s.use_present = use_present;
+    render_init(backend_name);
+    output_init();
+    governor_init();
+
     s.all_damage = None;
     s.clip_changed = True;
-    XGrabServer(s.dpy);
-    XCompositeRedirectSubwindows(s.dpy, s.root, CompositeRedirectManual);
-    XSelectInput(s.dpy, s.root,
-                 SubstructureNotifyMask |
-                     ExposureMask |
-                     StructureNotifyMask |
-                     PropertyChangeMask);
-    XShapeSelectInput(s.dpy, s.root, ShapeNotifyMask);
-    XQueryTree(s.dpy, s.root, &root_return, &parent_return, &children, &nchildren);
-    for (int i = 0; i < nchildren; i++)
-        add_win(children[i]);
-    XFree(children);
-    XUngrabServer(s.dpy);
+    s.current_desktop = -1;
+    update_current_desktop();
+    add_existing_windows();
+    update_active_window();
+    win_update_visibility();
+    // the outputs start damaged, session_loop paints them first
 
-    paint_all(None);
+    s.ufd[FD_EVENTS].fd = ingest_start();
+    s.ufd[FD_EVENTS].events = POLLIN;
 }
@@ -1,32 +1,62 @@
 #pragma once
 
+#include "governor.h"
 #include "window.h"
 #include <X11/Xlib.h>
 #include <X11/extensions/Xdamage.h>
 #include <X11/extensions/Xrender.h>
 #include <poll.h>
 
+// file descriptors session_loop waits on
+typedef enum _session_fd {
+    FD_EVENTS,  // readable when the event thread has queued events
+    FD_CONFIG,  // -1 when the config file is not watched
+    FD_CAPTURE, // capture clients connecting, see capture.h
+    NUM_FDS
+} session_fd;
+
 struct session {
     Display *dpy;
-    struct pollfd ufd;
+    struct pollfd ufd[NUM_FDS];
     win *managed_windows;
     int screen;
     Window root;
     Picture root_picture;
     Picture root_buffer;
+    Pixmap root_buffer_pixmap;
     Picture root_tile;
     XserverRegion all_damage;
     Bool clip_changed;
+    Bool visibility_changed; // a window was mapped, moved, restacked or changed mode
     int root_height, root_width;
     int xfixes_event, xfixes_error;
     int damage_event, damage_error;
     int composite_event, composite_error;
     int render_event, render_error;
     int xshape_event, xshape_error;
+    int xrandr_event, xrandr_error;
+    int sync_event, sync_error; // 0 without the Sync extension
     int composite_opcode;
     int effect_delta;
+    int damage_hot_rate, damage_cool_rate; // damage notifies per second, see damage_win
+    double inactive_dim;                   // 0 does not dim the inactive windows
+    double inactive_dim_step;              // dim change per effect step, 0 dims at once
+    Window active_window;                  // top level window holding the focus, None if there is none
+    int corner_radius[NUM_WINTYPES];       // 0 keeps the corners square
+    Bool overview;                         // the thumbnails are painted instead of the windows
+    Bool frame_governor;                   // lowers quality when frames are over budget, see governor.h
+    quality quality;
+    Bool use_present; // frames are presented to the overlay instead of copied to the root
+    long current_desktop, previous_desktop; // -1 when the window manager does not set them
+    int desktop_change_end;                 // in milliseconds, see update_current_desktop
 
+    Atom cm_atom; // _NET_WM_CM_Sn, losing it means another compix took over
     Atom opacity_atom;
+    Atom current_desktop_atom;
+    Atom active_window_atom;
+    Atom overview_atom;
+    Atom wm_desktop_atom;
+    Atom sync_counter_atom;
     Atom background_atoms[2];
     Atom winstate_atoms[6];
     Atom wintype_atoms[15];
@@ -36,4 +66,4 @@ extern struct session s;
 
 void session_loop(void);
 
-void session_init(const char *display, const char *config_path);
+void session_init(const char *display, const char *config_path, const char *backend_name, Bool use_present, Bool replace);
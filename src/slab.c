@@ -0,0 +1,36 @@
+#include "slab.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SLAB_SIZE 16384
+
+static void slab_grow(slab_pool *pool) {
+    size_t n = SLAB_SIZE / pool->object_size;
+    if (!n)
+        n = 1;
+    char *slab = malloc(n * pool->object_size);
+    if (!slab)
+        eprintf("out of memory\n");
+
+    // the objects of a new slab are pushed in reverse so that they are handed out in address order
+    for (size_t i = n; i > 0; i--) {
+        void **object = (void **) (slab + (i - 1) * pool->object_size);
+        *object = pool->free_list;
+        pool->free_list = object;
+    }
+}
+
+void *slab_alloc(slab_pool *pool) {
+    if (!pool->free_list)
+        slab_grow(pool);
+    void **object = pool->free_list;
+    pool->free_list = *object;
+    memset(object, 0, pool->object_size);
+    return object;
+}
+
+void slab_free(slab_pool *pool, void *object) {
+    *(void **) object = pool->free_list;
+    pool->free_list = object;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * allocator of objects of a single size, carved out of slabs that are never given back
+ * freed objects are kept in a free list and reused first
+ */
+typedef struct _slab_pool {
+    size_t object_size;
+    void *free_list;
+} slab_pool;
+
+#define SLAB_POOL(type) {.object_size = sizeof(type) > sizeof(void *) ? sizeof(type) : sizeof(void *), .free_list = NULL}
+
+/*
+ * returns a zeroed object
+ */
+void *slab_alloc(slab_pool *pool);
+
+void slab_free(slab_pool *pool, void *object);
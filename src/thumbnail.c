@@ -0,0 +1,61 @@
+#include "thumbnail.h"
+#include "render.h"
+#include "session.h"
+#include "util.h"
+#include "window.h"
+#include <X11/extensions/Xrender.h>
+#include <stdlib.h>
+
+typedef struct _thumbnail {
+    Picture picture; // argb so that argb windows keep their transparency
+    int width, height;
+    Bool stale; // the window was damaged since the picture was scaled
+} thumbnail;
+
+static thumbnail *thumbnail_new(int width, int height) {
+    thumbnail *t = malloc(sizeof(thumbnail));
+    Pixmap pixmap = XCreatePixmap(s.dpy, s.root, width, height, 32);
+    t->picture = XRenderCreatePicture(s.dpy, pixmap, XRenderFindStandardFormat(s.dpy, PictStandardARGB32), 0, NULL);
+    XFreePixmap(s.dpy, pixmap); // kept by the picture
+    t->width = width;
+    t->height = height;
+    t->stale = True;
+    return t;
+}
+
+Picture thumbnail_get(win *w, int width, int height) {
+    thumbnail *t = w->cold->thumbnail;
+    if (width <= 0 || height <= 0 || !w->damaged || !win_picture(w))
+        return None;
+
+    if (t && (t->width != width || t->height != height)) {
+        thumbnail_release(w);
+        t = NULL;
+    }
+    if (!t)
+        t = w->cold->thumbnail = thumbnail_new(width, height);
+
+    if (t->stale) {
+        // the same transform and filter as the scale effects, painting sets them back
+        set_picture_scale(w, (double) width / (w->attr.width + w->attr.border_width * 2));
+        set_ignore(NextRequest(s.dpy));
+        XRenderComposite(s.dpy, PictOpSrc, w->picture, None, t->picture,
+                         0, 0, 0, 0, 0, 0, width, height);
+        t->stale = False;
+    }
+    return t->picture;
+}
+
+void thumbnail_damage(win *w) {
+    if (w->cold->thumbnail)
+        w->cold->thumbnail->stale = True;
+}
+
+void thumbnail_release(win *w) {
+    thumbnail *t = w->cold->thumbnail;
+    if (!t)
+        return;
+    XRenderFreePicture(s.dpy, t->picture);
+    free(t);
+    w->cold->thumbnail = NULL;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "window.h"
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrender.h>
+
+/*
+ * downscaled copies of the window pictures for the overview, they are only scaled again
+ * when they are requested after the window was damaged
+ * thumbnails need the xrender backend, see render_pictures
+ */
+
+/*
+ * the thumbnail of w at the given size, None if the window can't be read
+ * the picture stays owned by the cache
+ */
+Picture thumbnail_get(win *w, int width, int height);
+
+/*
+ * the window contents changed, its thumbnail is scaled again on its next request
+ */
+void thumbnail_damage(win *w);
+
+void thumbnail_release(win *w);
@@ -0,0 +1,54 @@
+#ifdef TRACE
+#include "trace.h"
+#include "session.h"
+#include "util.h"
+#include <X11/Xlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static FILE *trace_out = NULL;
+static const char *separator = "";
+
+static unsigned long trace_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+static void trace_close(void) {
+    fprintf(trace_out, "\n]\n");
+    fclose(trace_out);
+    trace_out = NULL;
+}
+
+void trace_open(const char *path) {
+    trace_out = fopen(path, "w");
+    if (!trace_out)
+        eprintf("cannot open trace file %s\n", path);
+    // the closing bracket is optional, it is missing if compix is killed
+    fprintf(trace_out, "[");
+    atexit(trace_close);
+}
+
+void trace_begin(const char *name) {
+    if (!trace_out)
+        return;
+    fprintf(trace_out, "%s\n{\"name\":\"%s\",\"ph\":\"B\",\"pid\":1,\"tid\":1,\"ts\":%lu,\"args\":{\"serial\":%lu}}",
+            separator, name, trace_time(), s.dpy ? NextRequest(s.dpy) : 0);
+    separator = ",";
+}
+
+void trace_end(const char *name) {
+    if (!trace_out)
+        return;
+    fprintf(trace_out, "%s\n{\"name\":\"%s\",\"ph\":\"E\",\"pid\":1,\"tid\":1,\"ts\":%lu}",
+            separator, name, trace_time());
+    separator = ",";
+}
+
+void trace_flush(void) {
+    if (trace_out)
+        fflush(trace_out);
+}
+#endif
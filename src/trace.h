@@ -0,0 +1,29 @@
+#pragma once
+
+/*
+ * spans written to a Chrome trace event file (chrome://tracing, ui.perfetto.dev)
+ * the spans are only compiled in with -D TRACE (make trace), they cost nothing otherwise
+ * and only a test while no file is open
+ */
+#ifdef TRACE
+#define TRACE_BEGIN(name) trace_begin(name)
+#define TRACE_END(name) trace_end(name)
+#define TRACE_FLUSH() trace_flush()
+
+/*
+ * starts writing the spans to path, exits on failure
+ */
+void trace_open(const char *path);
+
+// the serial of the next request is recorded so spans can be matched with X requests
+void trace_begin(const char *name);
+
+void trace_end(const char *name);
+
+// called once per frame, the file is readable even if compix is killed
+void trace_flush(void);
+#else
+#define TRACE_BEGIN(name)
+#define TRACE_END(name)
+#define TRACE_FLUSH()
+#endif
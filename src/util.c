@@ -4,8 +4,11 @@
 #include <X11/extensions/Xcomposite.h>
 #include <X11/extensions/Xdamage.h>
 #include <X11/extensions/Xrender.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/time.h>
+#include <time.h>
 
 #ifdef DEBUG
 static const char *event_names[] = {
@@ -68,25 +71,95 @@ Window ev_window(XEvent *ev) {
 }
 #endif
 
-static unsigned long int *ignores = NULL;
-static size_t n_ignores = 0, size_ignores = 0;
+int get_time_in_milliseconds(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+uint64_t get_ust(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+const char *runtime_path(const char *name) {
+    static char path[256];
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    snprintf(path, sizeof(path), "%s/compix-%s-%s.%d", dir ? dir : "/tmp", name, DisplayString(s.dpy), s.screen);
+    for (char *p = path + strlen(dir ? dir : "/tmp") + 1; *p; p++)
+        if (*p == '/')
+            *p = '_';
+    return path;
+}
+
+/*
+ * ignored request serials, stored as ranges of consecutive serials in a ring buffer
+ * serials only grow so ranges are pushed at the tail and popped from the head
+ */
+typedef struct _ignore_range {
+    unsigned long int begin;
+    unsigned long int end; // included
+} ignore_range;
+
+// errors are handled by whichever thread reads them from the connection
+static pthread_mutex_t ignores_lock = PTHREAD_MUTEX_INITIALIZER;
+static ignore_range *ignores = NULL;
+static size_t head_ignores = 0, n_ignores = 0, size_ignores = 0; // size_ignores is a power of 2
+
+#define IGNORE_AT(i) ignores[(head_ignores + (i)) & (size_ignores - 1)]
+
+static void discard_ignore_locked(unsigned long int sequence) {
+    while (n_ignores && sequence > ignores[head_ignores].end) {
+        head_ignores = (head_ignores + 1) & (size_ignores - 1);
+        n_ignores--;
+    }
+}
 
 void discard_ignore(unsigned long int sequence) {
-    size_t i;
-    for (i = 0; i < n_ignores && sequence > ignores[i]; i++)
-        ;
-    memmove(ignores, &ignores[i], (n_ignores -= i) * sizeof(*ignores));
+    pthread_mutex_lock(&ignores_lock);
+    discard_ignore_locked(sequence);
+    pthread_mutex_unlock(&ignores_lock);
+}
+
+static void grow_ignores(void) {
+    size_t size = size_ignores ? size_ignores * 2 : 64;
+    ignore_range *ranges = malloc(size * sizeof(*ranges));
+    for (size_t i = 0; i < n_ignores; i++)
+        ranges[i] = IGNORE_AT(i);
+    free(ignores);
+    ignores = ranges;
+    size_ignores = size;
+    head_ignores = 0;
 }
 
 void set_ignore(unsigned long int sequence) {
+    pthread_mutex_lock(&ignores_lock);
+    if (n_ignores) {
+        ignore_range *last = &IGNORE_AT(n_ignores - 1);
+        if (sequence >= last->begin && sequence <= last->end + 1) {
+            if (sequence > last->end)
+                last->end = sequence;
+            pthread_mutex_unlock(&ignores_lock);
+            return;
+        }
+    }
+
     if (n_ignores == size_ignores)
-        ignores = realloc(ignores, (size_ignores += 64) * sizeof(*ignores));
-    ignores[n_ignores++] = sequence;
+        grow_ignores();
+    IGNORE_AT(n_ignores).begin = sequence;
+    IGNORE_AT(n_ignores).end = sequence;
+    n_ignores++;
+    pthread_mutex_unlock(&ignores_lock);
 }
 
 int should_ignore(unsigned long int sequence) {
-    discard_ignore(sequence);
-    return n_ignores && ignores[0] == sequence;
+    pthread_mutex_lock(&ignores_lock);
+    discard_ignore_locked(sequence);
+    int ignore = n_ignores && ignores[head_ignores].begin <= sequence;
+    pthread_mutex_unlock(&ignores_lock);
+    return ignore;
 }
 
 int handle_error(Display *display, XErrorEvent *ev) {
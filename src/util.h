@@ -23,6 +23,19 @@ const char *ev_name(XEvent *ev);
 Window ev_window(XEvent *ev);
 #endif
 
+int get_time_in_milliseconds(void);
+
+/*
+ * monotonic time in microseconds, the clock of the server for Present events and frame timings
+ */
+uint64_t get_ust(void);
+
+/*
+ * path of a file shared with the other programs of the display, in $XDG_RUNTIME_DIR or /tmp
+ * the string is overwritten by the next call
+ */
+const char *runtime_path(const char *name);
+
 void discard_ignore(unsigned long int sequence);
 void set_ignore(unsigned long int sequence);
 int should_ignore(unsigned long int sequence);
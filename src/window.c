@@ -1,9 +1,15 @@
 #include "window.h"
 #include "action.h"
 #include "effect.h"
+#include "frame.h"
+#include "framesync.h"
+#include "output.h"
+#include "props.h"
 #include "render.h"
 #include "session.h"
 void *tmp_;
+#include "slab.h"
+#include "thumbnail.h"
 #include "util.h"
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
@@ -11,6 +17,9 @@ void *tmp_;
 #include <stdlib.h>
 #include <string.h>
 
+static slab_pool win_pool = SLAB_POOL(win);
+static slab_pool win_cold_pool = SLAB_POOL(win_cold);
+
 static const char *wintypes_names[] = {"desktop", "dock", "toolbar", "menu", "utility",
                                        "splash", "dialog", "dropdown-menu", "popup-menu",
                                        "tooltip", "notification", "combo", "dnd", "normal"};
@@ -22,44 +31,100 @@ wintype get_wintype_from_name(const char *name) {
     return WINTYPE_UNKNOWN;
 }
 
+win *find_win(Window id, Bool include_prop_window) {
+    for (win *w = s.managed_windows; w; w = w->next)
+        if (w->id == id || (include_prop_window && w->cold->props_window_id == id))
+            return w;
+    return NULL;
+}
+
 /*
- * returns the window that truly holds the window properties or 'None' if it could not find it
+ * applies the effect scale (relative to the window center) and offset to geometry
  */
-static Window get_prop_window(Window id) {
-    
-    int n;
-    Atom *props = XListProperties(s.dpy, id, &n);
-    if (props)
-        return id;
-
-    unsigned int num_top_level_windows;
-    Window returned_root, returned_parent, *top_level_windows;
-    XQueryTree(s.dpy, id, &returned_root, &returned_parent, &top_level_windows, &num_top_level_windows);
-    /*
-    for (unsigned int i = 0; i < num_top_level_windows; i++) {
-        Window prop_window = get_prop_window(top_level_windows[i]);
-        if (prop_window)
-            return prop_window;
-    }*/
+void win_effect_geometry(win *w, XRectangle *geometry) {
+    double offset_x = (geometry->width - (geometry->width * w->scale)) / 2.0; // negative when upscaling
+    double offset_y = (geometry->height - (geometry->height * w->scale)) / 2.0;
+
+    geometry->width *= w->scale;
+    geometry->height *= w->scale;
+    geometry->x += offset_x + w->offset_x;
+    geometry->y += offset_y + w->offset_y;
+}
 
-    return None;
+Bool win_paint_effect(win *w) {
+    if (w->action_running) {
+        w->need_effect = True;
+    } else if (w->need_effect) {
+        w->need_effect = False;
+        return True;
+    }
+    return w->need_effect;
 }
 
-win *find_win(Window id, Bool include_prop_window) {
-    for (win *w = s.managed_windows; w; w = w->next)
-        if (w->id == id || (include_prop_window && w->props_window_id == id))
-            return w;
-    return NULL;
+/*
+ * while an effect is applied the extents also cover the scaled and moved window
+ */
+int win_extents_rects(win *w, XRectangle r[2]) {
+    COPY_AREA(&r[0], &w->attr);
+    r[0].width += w->attr.border_width * 2;
+    r[0].height += w->attr.border_width * 2;
+
+    if (!w->action_running && !w->need_effect)
+        return 1;
+
+    r[1] = r[0];
+    win_effect_geometry(w, &r[1]);
+    return 2;
 }
 
 XserverRegion win_extents(win *w) {
-    XRectangle r;
+    XRectangle r[2];
+    return XFixesCreateRegion(s.dpy, r, win_extents_rects(w, r));
+}
+
+/*
+ * recomputes the extents of a painted window and damages them
+ * used when an effect changed the area the window is painted to
+ */
+void win_update_extents(win *w) {
+    if (!w->extents)
+        return;
+
+    XFixesDestroyRegion(s.dpy, w->extents);
+    w->extents = win_extents(w);
+    add_damage(w->extents);
+}
+
+int win_corner_radius(win *w) {
+    if (w->cold->shaped || w->attr.class == InputOnly || WIN_GET_STATE(w, WINSTATE_FULLSCREEN))
+        return 0;
+    int radius = s.corner_radius[w->cold->window_type];
+    int width = w->attr.width + w->attr.border_width * 2;
+    int height = w->attr.height + w->attr.border_width * 2;
+    if (radius > width / 2)
+        radius = width / 2;
+    if (radius > height / 2)
+        radius = height / 2;
+    return radius;
+}
 
-    COPY_AREA(&r, &w->attr);
-    r.width += w->attr.border_width * 2;
-    r.height += w->attr.border_width * 2;
+void win_corner_rects(const XRectangle *geometry, int radius, XRectangle r[4]) {
+    for (int i = 0; i < 4; i++) {
+        r[i].x = i == 0 || i == 3 ? geometry->x : geometry->x + geometry->width - radius;
+        r[i].y = i < 2 ? geometry->y : geometry->y + geometry->height - radius;
+        r[i].width = r[i].height = radius;
+    }
+}
 
-    return XFixesCreateRegion(s.dpy, &r, 1);
+void win_interior_rects(const XRectangle *geometry, int radius, XRectangle r[3]) {
+    r[0] = r[1] = r[2] = *geometry;
+    // the bands between the corners and the full width middle
+    r[0].x = r[2].x = geometry->x + radius;
+    r[0].width = r[2].width = geometry->width - radius * 2;
+    r[0].height = r[2].height = radius;
+    r[2].y = geometry->y + geometry->height - radius;
+    r[1].y = geometry->y + radius;
+    r[1].height = geometry->height - radius * 2;
 }
 
 XserverRegion border_size(win *w) {
@@ -78,10 +143,133 @@ XserverRegion border_size(win *w) {
     XFixesTranslateRegion(s.dpy, border,
                           w->attr.x + w->attr.border_width,
                           w->attr.y + w->attr.border_width);
+
+    // the rounded corners are painted on their own, see paint_window
+    int radius = win_corner_radius(w);
+    if (radius) {
+        XRectangle geometry, corners[4];
+        COPY_AREA(&geometry, &w->attr);
+        geometry.width += w->attr.border_width * 2;
+        geometry.height += w->attr.border_width * 2;
+        win_corner_rects(&geometry, radius, corners);
+        set_ignore(NextRequest(s.dpy));
+        XFixesSubtractRegion(s.dpy, border, border, frame_region(corners, 4));
+    }
     return border;
 }
 
-static wintype determine_wintype(win *w);
+// maps and unmaps coming later than this after a desktop change are not part of it
+#define DESKTOP_CHANGE_DELAY 100
+
+// -1 if the window has no such property
+static long get_desktop(Window id, Atom atom) {
+    Atom actual;
+    int format;
+    unsigned long n, left;
+
+    unsigned char *data;
+    long desktop = -1;
+    set_ignore(NextRequest(s.dpy));
+    int result = XGetWindowProperty(s.dpy, id, atom, 0L, 1L, False,
+                                    XA_CARDINAL, &actual, &format,
+                                    &n, &left, &data);
+    if (result == Success && data != NULL) {
+        if (n)
+            desktop = *(unsigned long *) data;
+        XFree((void *) data);
+    }
+    return desktop;
+}
+
+void update_current_desktop(void) {
+    long desktop = get_desktop(s.root, s.current_desktop_atom);
+
+    if (desktop == s.current_desktop)
+        return;
+    if (s.current_desktop >= 0 && desktop >= 0) {
+        // a change while the previous one is still animated ends it first
+        action_group_end();
+        s.desktop_change_end = get_time_in_milliseconds() + DESKTOP_CHANGE_DELAY;
+    }
+    s.previous_desktop = s.current_desktop;
+    s.current_desktop = desktop;
+}
+
+long get_desktop_prop(win *w) {
+    return get_desktop(w->cold->props_window_id, s.wm_desktop_atom);
+}
+
+/*
+ * the effect of a window of the previous desktop being unmapped, or of the current one being mapped,
+ * right after a desktop change, NULL if the window is not part of it
+ */
+static effect *desktop_change_effect(win *w, Bool outgoing) {
+    if (w->cold->desktop < 0 || get_time_in_milliseconds() > s.desktop_change_end)
+        return NULL;
+    if (w->cold->desktop != (outgoing ? s.previous_desktop : s.current_desktop))
+        return NULL;
+    return effect_get(w->cold->window_type, EVENT_DESKTOP_CHANGE);
+}
+
+/*
+ * only application windows are dimmed, not docks, menus or the desktop
+ */
+static double win_dim_target(win *w) {
+    if (w->id == s.active_window)
+        return 0.0;
+    if (w->cold->window_type != WINTYPE_NORMAL && w->cold->window_type != WINTYPE_DIALOG)
+        return 0.0;
+    return s.inactive_dim;
+}
+
+void win_dim_all(void) {
+    for (win *w = s.managed_windows; w; w = w->next)
+        if (w->attr.map_state == IsViewable)
+            action_dim(w, win_dim_target(w));
+}
+
+/*
+ * the managed window holding id, _NET_ACTIVE_WINDOW is a client window of reparenting window managers
+ */
+static Window find_toplevel(Window id) {
+    while (id) {
+        win *w = find_win(id, True);
+        if (w)
+            return w->id;
+
+        Window root, parent, *children;
+        unsigned int n;
+        set_ignore(NextRequest(s.dpy));
+        if (!XQueryTree(s.dpy, id, &root, &parent, &children, &n))
+            return None;
+        if (children)
+            XFree(children);
+        id = parent == root ? None : parent;
+    }
+    return None;
+}
+
+void update_active_window(void) {
+    Atom actual;
+    int format;
+    unsigned long n, left;
+
+    unsigned char *data;
+    Window active = None;
+    int result = XGetWindowProperty(s.dpy, s.root, s.active_window_atom, 0L, 1L, False,
+                                    XA_WINDOW, &actual, &format,
+                                    &n, &left, &data);
+    if (result == Success && data != NULL) {
+        if (n)
+            active = find_toplevel(*(Window *) data);
+        XFree((void *) data);
+    }
+
+    if (active == s.active_window)
+        return;
+    s.active_window = active;
+    win_dim_all();
+}
 
 void map_win(Window id) {
     win *w = find_win(id, False);
@@ -89,39 +277,51 @@ void map_win(Window id) {
         return;
 
     w->attr.map_state = IsViewable;
+    s.visibility_changed = True;
 
-    Bool is_being_created = w->window_type == WINTYPE_UNKNOWN;
+    Bool is_being_created = w->cold->window_type == WINTYPE_UNKNOWN;
+
+    // This needs to be here since we don't get PropertyNotify when unmapped
+    // all the properties come in one round-trip, or none if they were prefetched
+    win_props props;
+    props_get(w->id, &props);
 
     // we do window properties related stuff here and not at creation because at creation there are not always set
     if (is_being_created) {
-        //if(w->attr.class != InputOnly && w->attr.map_state == 2 && w->attr.override_redirect == 0)
-            w->props_window_id = get_prop_window(w->id);
-        w->window_type = determine_wintype(w);
+        w->cold->props_window_id = props.props_window_id;
+        w->cold->window_type = props.window_type;
     }
 
     // This needs to be here or else we lose transparency messages
-    XSelectInput(s.dpy, w->props_window_id, PropertyChangeMask);
+    XSelectInput(s.dpy, w->cold->props_window_id, PropertyChangeMask);
 
-    // This needs to be here since we don't get PropertyNotify when unmapped
-    w->opacity = get_opacity_prop(w, 1.0);
+    w->opacity = props.opacity;
+    w->cold->desktop = props.desktop;
+    framesync_watch(w, props.sync_counter);
+    w->dim = w->cold->dim_target = win_dim_target(w);
     determine_mode(w);
 
     w->damaged = False;
 
     effect *e;
-    if ((e = effect_get(w->window_type, is_being_created ? EVENT_WINDOW_CREATE : EVENT_WINDOW_MAP)))
+    if ((e = desktop_change_effect(w, False)))
+        action_group_add(w, e, False);
+    else if ((e = effect_get(w->cold->window_type, is_being_created ? EVENT_WINDOW_CREATE : EVENT_WINDOW_MAP)))
         action_set(w, e, False, NULL, False, True);
 }
 
 void finish_unmap_win(win *w) {
     w->damaged = False;
+    thumbnail_release(w);
 
     if (w->extents != None) {
-        add_damage(w->extents); // destroys region
+        add_damage(w->extents);
+        XFixesDestroyRegion(s.dpy, w->extents);
         w->extents = None;
     }
 
     if (w->pixmap) {
+        render_release_win(w);
         XFreePixmap(s.dpy, w->pixmap);
         w->pixmap = None;
     }
@@ -141,12 +341,8 @@ void finish_unmap_win(win *w) {
         XFixesDestroyRegion(s.dpy, w->border_size);
         w->border_size = None;
     }
-    if (w->border_clip) {
-        XFixesDestroyRegion(s.dpy, w->border_clip);
-        w->border_clip = None;
-    }
-
     s.clip_changed = True;
+    s.visibility_changed = True;
 }
 
 static void unmap_callback(win *w, Bool gone) {
@@ -159,7 +355,9 @@ void unmap_win(Window id) {
         return;
     w->attr.map_state = IsUnmapped;
     effect *e;
-    if ((e = effect_get(w->window_type, EVENT_WINDOW_UNMAP)) && w->pixmap)
+    if ((e = desktop_change_effect(w, True)) && w->pixmap)
+        action_group_add(w, e, True);
+    else if ((e = effect_get(w->cold->window_type, EVENT_WINDOW_UNMAP)) && w->pixmap)
         action_set(w, e, True, unmap_callback, False, False);
     else
         finish_unmap_win(w);
@@ -175,7 +373,7 @@ double get_opacity_prop(win *w, double def) {
     unsigned long n, left;
 
     unsigned char *data;
-    int result = XGetWindowProperty(s.dpy, w->props_window_id, s.opacity_atom, 0L, 1L, False,
+    int result = XGetWindowProperty(s.dpy, w->cold->props_window_id, s.opacity_atom, 0L, 1L, False,
                                     XA_CARDINAL, &actual, &format,
                                     &n, &left, &data);
     if (result == Success && data != NULL) {
@@ -186,7 +384,7 @@ double get_opacity_prop(win *w, double def) {
     return def;
 }
 
-void determine_mode(win *w) {
+void win_set_mode(win *w) {
     int mode;
     XRenderPictFormat *format;
 
@@ -198,7 +396,7 @@ void determine_mode(win *w) {
     if (w->attr.class == InputOnly) {
         format = NULL;
     } else {
-        format = XRenderFindVisualFormat(s.dpy, w->attr.visual);
+        format = XRenderFindVisualFormat(s.dpy, w->cold->visual);
     }
 
     if (format && format->type == PictTypeDirect && format->direct.alphaMask) {
@@ -208,40 +406,15 @@ void determine_mode(win *w) {
     } else {
         mode = WINDOW_SOLID;
     }
+    if (w->mode != mode)
+        s.visibility_changed = True;
     w->mode = mode;
-    if (w->extents) {
-        XserverRegion damage;
-        damage = XFixesCreateRegion(s.dpy, NULL, 0);
-        XFixesCopyRegion(s.dpy, damage, w->extents);
-        add_damage(damage);
-    }
 }
 
-static wintype determine_wintype(win *w) {
-    Atom actual;
-    int format;
-    unsigned long n, left;
-
-    unsigned char *data;
-    // s.wintype_atoms[NUM_WINTYPES] is the _NET_WM_WINDOW_TYPE atom used to query a window type
-    int result = XGetWindowProperty(s.dpy, w->props_window_id, s.wintype_atoms[NUM_WINTYPES], 0L, 1L, False,
-                                    XA_ATOM, &actual, &format,
-                                    &n, &left, &data);
-
-    if (result == Success && data != (unsigned char *) None) {
-        Atom a = *(Atom *) data;
-        XFree((void *) data);
-
-        for (int i = 0; i < NUM_WINTYPES; i++)
-            if (s.wintype_atoms[i] == a)
-                return i;
-    }
-
-    Window transient_for;
-    result = XGetTransientForHint(s.dpy, w->id, &transient_for);
-    if (!result)
-        return WINTYPE_NORMAL;
-    return WINTYPE_DIALOG;
+void determine_mode(win *w) {
+    win_set_mode(w);
+    if (w->extents)
+        add_damage(w->extents);
 }
 
 void determine_winstate(win *w) {
@@ -250,12 +423,12 @@ void determine_winstate(win *w) {
     unsigned long n, left;
 
     unsigned char *data;
-    int result = XGetWindowProperty(s.dpy, w->props_window_id, s.winstate_atoms[NUM_WINSTATES], 0L, 12L, False,
+    int result = XGetWindowProperty(s.dpy, w->cold->props_window_id, s.winstate_atoms[NUM_WINSTATES], 0L, 12L, False,
                                     XA_ATOM, &actual, &format,
                                     &n, &left, &data);
     if (result == Success && data != NULL) {
-        Bool prev_state = w->state;
-        w->state = 0;
+        Bool prev_state = w->cold->state;
+        w->cold->state = 0;
         Atom *a = (Atom *) data;
         for (int i = 0; i < n; i++) {
             if (a[i] == s.winstate_atoms[WINSTATE_MAXIMIZED_VERT]) {
@@ -266,35 +439,45 @@ void determine_winstate(win *w) {
                 WIN_SET_STATE(w, WINSTATE_FULLSCREEN);
             }
         }
-        if (prev_state != w->state)
-            w->maximize_state_changed = True;
+        if (prev_state != w->cold->state)
+            w->cold->maximize_state_changed = True;
 
         XFree((void *) data);
     }
 }
 
-void add_win(Window id) {
-    win *w = calloc(1, sizeof(win));
+win *manage_win(Window id, const XWindowAttributes *attr) {
+    win *w = slab_alloc(&win_pool);
+    w->cold = slab_alloc(&win_cold_pool);
     w->id = id;
-    set_ignore(NextRequest(s.dpy));
-    if (!XGetWindowAttributes(s.dpy, id, &w->attr)) {
-        free(w);
-        return;
-    }
-
-    w->shaped = False;
-    w->shape_bounds.x = w->attr.x;
-    w->shape_bounds.y = w->attr.y;
-    w->shape_bounds.width = w->attr.width;
-    w->shape_bounds.height = w->attr.height;
+    w->attr.x = attr->x;
+    w->attr.y = attr->y;
+    w->attr.width = attr->width;
+    w->attr.height = attr->height;
+    w->attr.border_width = attr->border_width;
+    w->attr.class = attr->class;
+    w->attr.map_state = attr->map_state;
+    w->cold->visual = attr->visual;
+    w->cold->depth = attr->depth;
+    w->cold->override_redirect = attr->override_redirect;
+
+    w->cold->shaped = False;
+    w->cold->shape_bounds.x = w->attr.x;
+    w->cold->shape_bounds.y = w->attr.y;
+    w->cold->shape_bounds.width = w->attr.width;
+    w->cold->shape_bounds.height = w->attr.height;
 
     w->damaged = False;
+    w->contents_changed = False;
     w->pixmap = None;
     w->picture = None;
+    w->backend_data = NULL;
 
-    w->damage = w->attr.class == InputOnly ? None : XDamageCreate(s.dpy, id, XDamageReportNonEmpty);
+    w->cold->damage = w->attr.class == InputOnly ? None : XDamageCreate(s.dpy, id, XDamageReportNonEmpty);
 
     w->alpha_picture = None;
+    w->transform.scale = XDoubleToFixed(1.0);
+    w->transform.smooth = False;
     w->border_size = None;
     w->extents = None;
     w->opacity = 1.0;
@@ -306,16 +489,32 @@ void add_win(Window id) {
     w->need_effect = False;
     w->action_running = False;
 
-    w->maximize_state_changed = False;
-    w->state = 0;
+    w->cold->maximize_state_changed = False;
+    w->cold->state = 0;
 
     w->prev_trans = NULL;
 
-    w->window_type = WINTYPE_UNKNOWN;
+    w->cold->window_type = WINTYPE_UNKNOWN;
+    w->cold->desktop = -1;
+    w->dim = 0.0;
+    w->cold->dim_target = 0.0;
+    w->cold->thumbnail = NULL;
+    w->cold->sync_counter = None;
+    w->cold->sync_alarm = None;
 
     w->next = s.managed_windows;
     s.managed_windows = w;
 
+    return w;
+}
+
+void add_win(Window id) {
+    XWindowAttributes attr;
+    set_ignore(NextRequest(s.dpy));
+    if (!XGetWindowAttributes(s.dpy, id, &attr))
+        return;
+
+    win *w = manage_win(id, &attr);
     if (w->attr.map_state == IsViewable)
         map_win(id);
 }
@@ -344,38 +543,48 @@ void restack_win(win *w, Window new_above) {
 
 void configure_win(XConfigureEvent *ce) {
     win *w = find_win(ce->window, False);
-    XserverRegion damage = None;
 
     if (!w) {
         if (ce->window == s.root) {
             if (s.root_buffer) {
                 XRenderFreePicture(s.dpy, s.root_buffer);
+                XFreePixmap(s.dpy, s.root_buffer_pixmap);
                 s.root_buffer = None;
+                s.root_buffer_pixmap = None;
             }
             s.root_width = ce->width;
             s.root_height = ce->height;
+            output_update();
+            s.visibility_changed = True;
         }
         return;
     }
 
     // if maximize_state_changed and we are in a configure event, this is a real maximize/fullscreen state change
     // maybe add a check if the configure event if really for a window resize/move
-    if (w->maximize_state_changed) {
+    if (w->cold->maximize_state_changed) {
         effect *e;
-        if ((e = effect_get(w->window_type, EVENT_WINDOW_MAXIMIZE)) && w->pixmap)
+        if ((e = effect_get(w->cold->window_type, EVENT_WINDOW_MAXIMIZE)) && w->pixmap)
             action_set(w, e, False, NULL, False, True);
-        w->maximize_state_changed = False;
+        w->cold->maximize_state_changed = False;
     }
 
-    damage = XFixesCreateRegion(s.dpy, NULL, 0);
+    // the old and the new extents are damaged
     if (w->extents != None)
-        XFixesCopyRegion(s.dpy, damage, w->extents);
+        add_damage(w->extents);
 
-    w->shape_bounds.x -= w->attr.x;
-    w->shape_bounds.y -= w->attr.y;
+    int dx = ce->x - w->attr.x;
+    int dy = ce->y - w->attr.y;
+    // only the size changes the shape of the regions of the window, a move translates them
+    Bool resized = w->attr.width != ce->width || w->attr.height != ce->height ||
+                   w->attr.border_width != ce->border_width;
+    w->cold->shape_bounds.x -= w->attr.x;
+    w->cold->shape_bounds.y -= w->attr.y;
 
     if (w->attr.width != ce->width || w->attr.height != ce->height) {
+        thumbnail_damage(w);
         if (w->pixmap) {
+            render_release_win(w);
             XFreePixmap(s.dpy, w->pixmap);
             w->pixmap = None;
             if (w->picture) {
@@ -387,22 +596,34 @@ void configure_win(XConfigureEvent *ce) {
 
     COPY_AREA(&w->attr, ce);
     w->attr.border_width = ce->border_width;
-    w->attr.override_redirect = ce->override_redirect;
+    w->cold->override_redirect = ce->override_redirect;
     restack_win(w, ce->above);
-    if (damage) {
-        XserverRegion extents = win_extents(w);
-        XFixesUnionRegion(s.dpy, damage, damage, extents);
-        XFixesDestroyRegion(s.dpy, extents);
-        add_damage(damage);
+    w->cold->shape_bounds.x += w->attr.x;
+    w->cold->shape_bounds.y += w->attr.y;
+    if (!w->cold->shaped) {
+        w->cold->shape_bounds.width = w->attr.width;
+        w->cold->shape_bounds.height = w->attr.height;
     }
-    w->shape_bounds.x += w->attr.x;
-    w->shape_bounds.y += w->attr.y;
-    if (!w->shaped) {
-        w->shape_bounds.width = w->attr.width;
-        w->shape_bounds.height = w->attr.height;
+
+    if (resized) {
+        s.clip_changed = True;
+    } else if (dx || dy) {
+        if (w->border_size)
+            XFixesTranslateRegion(s.dpy, w->border_size, dx, dy);
+        effect *e;
+        if ((e = effect_get(w->cold->window_type, EVENT_WINDOW_MOVE)) && w->pixmap)
+            action_move(w, e, dx, dy);
     }
 
-    s.clip_changed = True;
+    XRectangle r[2];
+    int n = win_extents_rects(w, r);
+    if (w->extents != None) {
+        XFixesSetRegion(s.dpy, w->extents, r, n);
+        add_damage(w->extents);
+    } else {
+        add_damage(frame_region(r, n));
+    }
+    s.visibility_changed = True;
 }
 
 void circulate_win(XCirculateEvent *ce) {
@@ -418,6 +639,7 @@ void circulate_win(XCirculateEvent *ce) {
         new_above = None;
     restack_win(w, new_above);
     s.clip_changed = True;
+    s.visibility_changed = True;
 }
 
 static void finish_destroy_win(Window id, Bool gone) {
@@ -436,13 +658,17 @@ static void finish_destroy_win(Window id, Bool gone) {
                 XRenderFreePicture(s.dpy, w->alpha_picture);
                 w->alpha_picture = None;
             }
-            if (w->damage != None) {
+            if (w->cold->damage != None) {
                 set_ignore(NextRequest(s.dpy));
-                XDamageDestroy(s.dpy, w->damage);
-                w->damage = None;
+                XDamageDestroy(s.dpy, w->cold->damage);
+                w->cold->damage = None;
             }
             action_cleanup(w);
-            free(w);
+            thumbnail_release(w);
+            framesync_release(w);
+            render_release_win(w);
+            slab_free(&win_cold_pool, w->cold);
+            slab_free(&win_pool, w);
             break;
         }
     }
@@ -455,34 +681,120 @@ static void destroy_callback(win *w, Bool gone) {
 void destroy_win(Window id, Bool gone) {
     win *w = find_win(id, False);
     effect *e;
-    if (w && (e = effect_get(w->window_type, EVENT_WINDOW_DESTROY)) && w->pixmap)
+    if (w && (e = effect_get(w->cold->window_type, EVENT_WINDOW_DESTROY)) && w->pixmap)
         action_set(w, e, True, destroy_callback, gone, False);
     else
         finish_destroy_win(id, gone);
 }
 
+/*
+ * windows damaged many times per second (video, games) are usually redrawn as a whole
+ * fetching their damaged parts then only costs requests, so they are damaged as a whole until they calm down
+ */
+static void update_damage_rate(win *w) {
+    win_cold *c = w->cold;
+    int now = get_time_in_milliseconds();
+    int elapsed = now - c->damage_rate_start;
+
+    c->damage_count++;
+    if (elapsed < 1000)
+        return;
+
+    int rate = c->damage_count * 1000 / elapsed;
+    if (!c->damage_whole && s.damage_hot_rate && rate >= s.damage_hot_rate)
+        c->damage_whole = True;
+    else if (c->damage_whole && (!s.damage_hot_rate || rate < s.damage_cool_rate))
+        c->damage_whole = False;
+    c->damage_count = 0;
+    c->damage_rate_start = now;
+}
+
 void damage_win(XDamageNotifyEvent *de) {
     XserverRegion parts;
     win *w = find_win(de->drawable, False);
     if (!w)
         return;
 
-    if (!w->damaged) {
-        parts = win_extents(w);
+    update_damage_rate(w);
+    w->contents_changed = True;
+    thumbnail_damage(w);
+    // hidden windows only get their damage acknowledged, they are repainted once when they show up
+    // the overview shows every window, their damage repaints it
+    if (w->damaged && !w->cold->visible && !s.overview) {
         set_ignore(NextRequest(s.dpy));
-        XDamageSubtract(s.dpy, w->damage, None, None);
+        XDamageSubtract(s.dpy, w->cold->damage, None, None);
+        w->cold->damage_skipped = True;
+        return;
+    }
+
+    if (!w->damaged || w->cold->damage_whole) {
+        XRectangle r[2];
+        parts = frame_region(r, win_extents_rects(w, r));
+        set_ignore(NextRequest(s.dpy));
+        XDamageSubtract(s.dpy, w->cold->damage, None, None);
     } else {
-        parts = XFixesCreateRegion(s.dpy, NULL, 0);
+        parts = frame_region(NULL, 0);
         set_ignore(NextRequest(s.dpy));
-        XDamageSubtract(s.dpy, w->damage, None, parts);
+        XDamageSubtract(s.dpy, w->cold->damage, None, parts);
         XFixesTranslateRegion(s.dpy, parts,
                               w->attr.x + w->attr.border_width,
                               w->attr.y + w->attr.border_width);
     }
     add_damage(parts);
+    // its first damage makes the window cover the ones below
+    if (!w->damaged)
+        s.visibility_changed = True;
     w->damaged = True;
 }
 
+/*
+ * a window is visible if part of it is on screen and not covered by the opaque windows above it
+ * windows moved by an effect, shaped or never painted don't hide the windows below them
+ */
+void win_update_visibility(void) {
+    XRectangle screen = {0, 0, s.root_width, s.root_height};
+    Region covered = XCreateRegion();
+
+    for (win *w = s.managed_windows; w; w = w->next) {
+        if (w->attr.map_state != IsViewable || w->attr.class == InputOnly)
+            continue;
+
+        XRectangle r[2];
+        int n = win_extents_rects(w, r);
+        Bool visible = False;
+        for (int i = 0; i < n && !visible; i++) {
+            int x1 = r[i].x > 0 ? r[i].x : 0;
+            int y1 = r[i].y > 0 ? r[i].y : 0;
+            int x2 = r[i].x + r[i].width < screen.width ? r[i].x + r[i].width : screen.width;
+            int y2 = r[i].y + r[i].height < screen.height ? r[i].y + r[i].height : screen.height;
+            if (x1 < x2 && y1 < y2 && XRectInRegion(covered, x1, y1, x2 - x1, y2 - y1) != RectangleIn)
+                visible = True;
+        }
+
+        if (visible && w->cold->damage_skipped) {
+            add_damage(frame_region(r, n));
+            w->cold->damage_skipped = False;
+        }
+        w->cold->visible = visible;
+
+        // a window never painted does not cover anything yet, paint_all skips it
+        if (w->damaged && w->mode == WINDOW_SOLID && !w->cold->shaped && !w->action_running && !w->need_effect) {
+            int radius = win_corner_radius(w);
+            if (radius) {
+                // what is under the rounded corners shows through
+                XRectangle interior[3];
+                win_interior_rects(&r[0], radius, interior);
+                for (int i = 0; i < 3; i++)
+                    XUnionRectWithRegion(&interior[i], covered, covered);
+            } else {
+                XUnionRectWithRegion(&r[0], covered, covered);
+            }
+        }
+    }
+    XDestroyRegion(covered);
+    s.visibility_changed = False;
+}
+
 void shape_win(XShapeEvent *se) {
     win *w = find_win(se->window, False);
 
@@ -494,28 +806,28 @@ void shape_win(XShapeEvent *se) {
         XserverRegion region1;
 
         s.clip_changed = True;
+        s.visibility_changed = True;
 
-        region0 = XFixesCreateRegion(s.dpy, &w->shape_bounds, 1);
+        region0 = frame_region(&w->cold->shape_bounds, 1);
 
         if (se->shaped == True) {
-            w->shaped = True;
-            w->shape_bounds.x = w->attr.x + se->x;
-            w->shape_bounds.y = w->attr.y + se->y;
-            w->shape_bounds.width = se->width;
-            w->shape_bounds.height = se->height;
+            w->cold->shaped = True;
+            w->cold->shape_bounds.x = w->attr.x + se->x;
+            w->cold->shape_bounds.y = w->attr.y + se->y;
+            w->cold->shape_bounds.width = se->width;
+            w->cold->shape_bounds.height = se->height;
         } else {
-            w->shaped = False;
-            w->shape_bounds.x = w->attr.x;
-            w->shape_bounds.y = w->attr.y;
-            w->shape_bounds.width = w->attr.width;
-            w->shape_bounds.height = w->attr.height;
+            w->cold->shaped = False;
+            w->cold->shape_bounds.x = w->attr.x;
+            w->cold->shape_bounds.y = w->attr.y;
+            w->cold->shape_bounds.width = w->attr.width;
+            w->cold->shape_bounds.height = w->attr.height;
         }
 
-        region1 = XFixesCreateRegion(s.dpy, &w->shape_bounds, 1);
+        region1 = frame_region(&w->cold->shape_bounds, 1);
         XFixesUnionRegion(s.dpy, region0, region0, region1);
-        XFixesDestroyRegion(s.dpy, region1);
 
-        /* ask for repaint of the old and new region */
-        paint_all(region0);
+        /* ask for repaint of the old and new region, painted by session_loop with the other damage */
+        add_damage(region0);
     }
 }
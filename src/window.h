@@ -35,50 +35,123 @@ typedef enum _wintype {
     WINTYPE_UNKNOWN
 } wintype;
 
-typedef struct _win {
-    struct _win *next;
-    Window id;
-    Pixmap pixmap;
-    XWindowAttributes attr;
+// transform and filter currently set on a window picture
+typedef struct _win_transform {
+    XFixed scale; // XDoubleToFixed(1.0) is identity
+    Bool smooth;  // FilterBest when True, FilterFast otherwise
+} win_transform;
+
+// the window attributes read when painting
+typedef struct _win_attr {
+    int x, y;
+    int width, height;
+    int border_width;
+    int class;
+    int map_state;
+} win_attr;
+
+// window data only read when handling events, kept apart from the fields walked every frame
+typedef struct _win_cold {
+    Visual *visual;
+    int depth;
+    Bool override_redirect;
 
     // some programs do not put their properties their window but in a child window (see xterm)
     // so we store the window that holds these properties in this variable
     Window props_window_id;
-
-    int mode;
-    Bool maximize_state_changed;
+    wintype window_type;
     unsigned int state;
-    Bool damaged;
+    Bool maximize_state_changed;
+    long desktop; // _NET_WM_DESKTOP, -1 when unknown
+
     Damage damage;
-    Picture picture;
-    Picture alpha_picture;
-    XserverRegion border_size;
-    XserverRegion extents;
-    wintype window_type;
+    Bool visible;        // see win_update_visibility
+    Bool damage_skipped; // damaged while not visible
+    Bool damage_whole;     // the window is damaged as a whole instead of fetching the damaged parts
+    int damage_count;      // notifies since damage_rate_start
+    int damage_rate_start; // in milliseconds
     Bool shaped;
     XRectangle shape_bounds;
+    double dim_target; // dim the window fades to, see action_dim
+    struct _thumbnail *thumbnail; // NULL until the thumbnail is requested, see thumbnail_get
+    XID sync_counter; // extended _NET_WM_SYNC_REQUEST_COUNTER, None if the client does not sync its frames
+    XID sync_alarm;   // reports the changes of sync_counter, see framesync.h
+} win_cold;
 
+typedef struct _win {
+    struct _win *next;
+    Window id;
+    win_attr attr;
+
+    int mode;
     double opacity;
+    double dim; // darkness painted over an inactive window, from 0 to s.inactive_dim
+    Bool damaged;
+    Bool contents_changed; // damaged since the backend last read the pixmap
+    Bool need_effect;      // used to apply effects when painting a window
+    Bool action_running;
     double scale;
     int offset_x;
     int offset_y;
-    Bool need_effect; // used to apply effects when painting a window
-    Bool action_running;
+
+    Pixmap pixmap;
+    Picture picture;
+    Picture alpha_picture;
+    win_transform transform;
+    XserverRegion border_size;
+    XserverRegion extents;
 
     /* for drawing translucent windows */
     XserverRegion border_clip;
     struct _win *prev_trans;
+
+    void *backend_data; // owned by the backend, see render_release_win
+
+    win_cold *cold;
 } win;
 
-#define WIN_SET_STATE(w, wstate) w->state |= 1U << wstate
-#define WIN_GET_STATE(w, wstate) (w->state >> wstate) & 1U
+#define WIN_SET_STATE(w, wstate) w->cold->state |= 1U << wstate
+#define WIN_GET_STATE(w, wstate) (w->cold->state >> wstate) & 1U
 
 wintype get_wintype_from_name(const char *name);
 
 win *find_win(Window id, Bool include_prop_window);
 
+/*
+ * True if the effect scale and offset must be applied when painting the window
+ * they stay applied for one more paint after the action ended
+ */
+Bool win_paint_effect(win *w);
+
+void win_effect_geometry(win *w, XRectangle *geometry);
+
+/*
+ * fills the rectangles covered by the window and returns their count
+ */
+int win_extents_rects(win *w, XRectangle r[2]);
+
 XserverRegion win_extents(win *w);
 
+void win_update_extents(win *w);
+
+/*
+ * radius of the rounded corners of w, 0 if they are square
+ */
+int win_corner_radius(win *w);
+
+/*
+ * the corner squares of geometry, top left first and clockwise
+ */
+void win_corner_rects(const XRectangle *geometry, int radius, XRectangle r[4]);
+
+/*
+ * geometry without its corner squares
+ */
+void win_interior_rects(const XRectangle *geometry, int radius, XRectangle r[3]);
+
+/*
+ * region painted by the window, without its rounded corners
+ */
 XserverRegion border_size(win *w);
 
 void map_win(Window id);
@@ -93,10 +166,39 @@ void unmap_win(Window id);
  */
 double get_opacity_prop(win *w, double def);
 
+/*
+ * reads the root _NET_CURRENT_DESKTOP, when it changed the windows mapped and unmapped right after
+ * are animated together by the desktop change effect
+ */
+void update_current_desktop(void);
+
+long get_desktop_prop(win *w);
+
+/*
+ * reads the root _NET_ACTIVE_WINDOW, the other windows are dimmed
+ */
+void update_active_window(void);
+
+/*
+ * fades every window to the dim it must have, after the active window or the dim options changed
+ */
+void win_dim_all(void);
+
+/*
+ * same as determine_mode without damaging the window
+ */
+void win_set_mode(win *w);
+
 void determine_mode(win *w);
 
 void determine_winstate(win *w);
 
+/*
+ * starts managing a window whose attributes are already known
+ * unlike add_win it does not map the window
+ */
+win *manage_win(Window id, const XWindowAttributes *attr);
+
 void add_win(Window id);
 
 void restack_win(win *w, Window new_above);
@@ -110,3 +212,9 @@ void destroy_win(Window id, Bool gone);
 void damage_win(XDamageNotifyEvent *de);
 
 void shape_win(XShapeEvent *se);
+
+/*
+ * recomputes which windows can be seen, hidden windows don't damage the screen
+ * a window showing up after damage was skipped is damaged as a whole
+ */
+void win_update_visibility(void);